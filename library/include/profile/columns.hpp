@@ -0,0 +1,85 @@
+#ifndef __COLUMNS_HPP__
+#define __COLUMNS_HPP__
+
+#ifdef FEATURE_IO_READ
+
+#include "profile.hpp"
+#include <memory>
+
+namespace profile { namespace io {
+
+	struct file_contents;
+	class columns;
+
+	namespace binary
+	{
+		bool read_columns(const columns& file, file_contents& out, int flags);
+	}
+
+	// A .ccount file written by io::columns_write, mapped into memory.
+	// Each column is an array of call_count() values, the n-th value of
+	// each belonging to the same call, used in place without parsing;
+	// e.g. summing durations() by functions() needs no profile at all.
+	// The arrays last until close(). The ids are of 32 bits, unless the
+	// writer needed 64, so they are taken one at a time, by id() and
+	// parent(). io::read builds a profile out of the same file, for
+	// everything else.
+	class columns
+	{
+		struct mapping;
+
+		std::unique_ptr<mapping> m_mapping;
+		size_t m_calls;
+		size_t m_functions;
+		time::type m_second;
+		const char* m_strings;
+		size_t m_strings_size;
+		const unsigned int* m_function_table; // id, name, suffix
+		bool m_wide;
+		const char* m_ids;
+		const char* m_parents;
+		const function_id* m_called;
+		const unsigned int* m_flags;
+		const time::type* m_durations;
+		const time::type* m_self;
+		const char* m_blocks;
+		size_t m_blocks_size;
+
+		friend bool binary::read_columns(const columns& file, file_contents& out, int flags);
+
+	public:
+		struct function
+		{
+			function_id id;
+			const char* name;
+			const char* suffix;
+		};
+
+		columns();
+		~columns();
+
+		columns(const columns&) = delete;
+		columns& operator=(const columns&) = delete;
+
+		bool open(const char* path);
+		void close();
+
+		size_t call_count() const { return m_calls; }
+		size_t function_count() const { return m_functions; }
+		time::type second() const { return m_second; }
+
+		call_id id(size_t index) const { return m_wide ? ((const call_id*) m_ids)[index] : ((const unsigned int*) m_ids)[index]; }
+		call_id parent(size_t index) const { return m_wide ? ((const call_id*) m_parents)[index] : ((const unsigned int*) m_parents)[index]; } // zero for none
+		const function_id* functions() const { return m_called; }
+		const unsigned int* flags() const { return m_flags; }
+		const time::type* durations() const { return m_durations; }
+		const time::type* self() const { return m_self; } // collecting::call::NO_SELF for unknown
+
+		function function_at(size_t index) const;
+	};
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
+
+#endif // __COLUMNS_HPP__
@@ -0,0 +1,56 @@
+#ifndef __COUNTERS_HPP__
+#define __COUNTERS_HPP__
+
+#ifdef FEATURE_IO_WRITE
+
+namespace profile { namespace counters {
+
+	enum
+	{
+		MAX_COUNTERS = 4
+	};
+
+	enum ECounters
+	{
+		ECounters_OFF,
+		ECounters_HARDWARE, // instructions, cycles, cache and branch misses
+		ECounters_SOFTWARE  // task clock, page faults, context switches, migrations
+	};
+
+	struct sample
+	{
+		unsigned int mask; // of the counters read
+		unsigned int generation; // changed by start(), which opens the counters anew
+		unsigned long long value[MAX_COUNTERS];
+	};
+
+	// Opt-in performance counters, read by each probe as it starts and
+	// stops; the differences are kept as attributes of the call, named
+	// after the counters, unless the counters were opened anew in between. The counters of a thread are opened by its
+	// first probe and read in user space, where the kernel allows it.
+	// When the hardware ones are refused, e.g. in a container, start()
+	// settles for the software ones, and for nothing when even those are
+	// refused. Returns what was settled for.
+	ECounters start(ECounters preferred = ECounters_HARDWARE);
+	void stop();
+
+	ECounters mode();
+
+	// null for the counters of the mode, which could not be opened
+	const char* name(unsigned int counter);
+
+	// false, when this thread is not counting
+	bool read(sample& out);
+
+	struct session
+	{
+		ECounters m_mode;
+		session(ECounters preferred = ECounters_HARDWARE): m_mode(start(preferred)) {}
+		~session() { if (m_mode != ECounters_OFF) stop(); }
+	};
+
+}} // profile::counters
+
+#endif // FEATURE_IO_WRITE
+
+#endif // __COUNTERS_HPP__
@@ -0,0 +1,45 @@
+#ifndef __CRASH_HPP__
+#define __CRASH_HPP__
+
+#include "profile.hpp"
+
+namespace profile { namespace crash {
+
+#ifdef FEATURE_IO_WRITE
+
+	// On SIGSEGV, SIGBUS, SIGILL, SIGFPE or SIGABRT, writes the calls of
+	// the session and the probes still open on each thread to the file,
+	// which is opened right away, so the handler only needs write(). The
+	// handler takes no lock it would have to wait for and allocates
+	// nothing; other threads are not stopped, so what they were doing at
+	// the time may come out torn. The signal is then raised again with
+	// its default action. io::crash_recover makes a .count file out of
+	// the dump; uninstall() removes it, when there was no crash.
+	bool install(const char* path, collecting::session& session = collecting::session::current());
+	void uninstall();
+
+	struct session
+	{
+		bool m_installed;
+		session(const char* path): m_installed(install(path)) {}
+		~session() { if (m_installed) uninstall(); }
+	};
+
+#endif // FEATURE_IO_WRITE
+
+}} // profile::crash
+
+#ifdef FEATURE_IO_READ
+
+namespace profile { namespace io {
+
+	// The calls open at the crash last until the crash and carry the
+	// signal in the "crashed" attribute. A dump cut short by a second
+	// crash is recovered up to where it ends.
+	bool crash_recover(const char* dump, const char* output);
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
+
+#endif // __CRASH_HPP__
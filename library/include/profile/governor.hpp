@@ -0,0 +1,48 @@
+#ifndef __GOVERNOR_HPP__
+#define __GOVERNOR_HPP__
+
+#ifdef FEATURE_IO_WRITE
+
+#include "profile.hpp"
+
+namespace profile { namespace governor {
+
+	enum
+	{
+		DEFAULT_WINDOW = 100, // ms
+		SAMPLING_RATE = 16    // one call kept out of that many
+	};
+
+	// Keeps the estimated cost of the probes under a percent of the wall
+	// time. Every window, the hits of each section are weighed against
+	// the probe costs calibrated by start(); while over the limit, the
+	// sections costing the most go from full recording to counting the
+	// calls in their aggregates only, and on the next occasion to keeping
+	// one call in SAMPLING_RATE without timing the others, the cheapest.
+	// Sections are never upgraded back.
+	// Each downgrade is kept in the governed session, so the viewer can
+	// tell which numbers are incomplete. One session is governed at a time;
+	// the first overload governs the current one.
+	bool start(double percent, unsigned int window_ms = DEFAULT_WINDOW);
+	bool start(collecting::session& session, double percent, unsigned int window_ms = DEFAULT_WINDOW);
+	void stop();
+
+	// calibrated cost of a probe, in ticks, by what happens to its call
+	time::type cost(EAdmit admit);
+
+	// called by the finishing probes while the governor runs
+	void tick();
+
+	struct session
+	{
+		bool m_started;
+		session(double percent, unsigned int window_ms = DEFAULT_WINDOW): m_started(start(percent, window_ms)) {}
+		session(collecting::session& governed, double percent, unsigned int window_ms = DEFAULT_WINDOW): m_started(start(governed, percent, window_ms)) {}
+		~session() { if (m_started) stop(); }
+	};
+
+}} // profile::governor
+
+#endif // FEATURE_IO_WRITE
+
+#endif // __GOVERNOR_HPP__
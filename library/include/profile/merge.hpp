@@ -0,0 +1,29 @@
+#ifndef __MERGE_HPP__
+#define __MERGE_HPP__
+
+#ifdef FEATURE_IO_READ
+
+#include <string>
+#include <vector>
+
+namespace profile { namespace io {
+
+	// Combines the .count files of several processes into one. Functions
+	// are matched by name and suffix. The call ids of the processes of one
+	// tree are kept, so the calls of a child stay under the open calls of
+	// its parent; otherwise, when the ranges of ids of the files overlap,
+	// the ids of each file are moved past the ones of the files before it.
+	// Each file keeps a process entry with its range of calls. Every input
+	// is read once, front to back, holding only the strings and functions
+	// of all the inputs (and the self times of the files of 1.0); read
+	// twice, if the moved ids outgrow 32 bits, for an output of 2.1
+	// instead of 2.0.
+	// Chunked files, files of unknown versions, or from a clock of another
+	// frequency, are not merged.
+	bool binary_merge(const char* output, const std::vector<std::string>& inputs);
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
+
+#endif // __MERGE_HPP__
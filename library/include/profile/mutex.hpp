@@ -0,0 +1,325 @@
+#ifndef __MUTEX_HPP__
+#define __MUTEX_HPP__
+
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include "profile.hpp"
+
+namespace profile { namespace mt {
+
+#ifdef FEATURE_IO_WRITE
+
+	enum
+	{
+		HOLD_SAMPLING = 64 // one in so many uncontended holds is timed
+	};
+
+	// Drop-in replacements for the standard locks. Each lock is named after
+	// its site; a contended acquisition is recorded as a "<site>/wait" call
+	// (ECallFlag_LOCK_WAIT) under the current probe and the following hold
+	// as "<site>/hold" (ECallFlag_LOCK_HOLD), the number of wait calls being
+	// the contention count. An uncontended acquisition is a single try_lock
+	// and a count; one in HOLD_SAMPLING of them is timed and its hold kept
+	// as "<site>/hold (sampled)", for how long the lock is held in general
+	// and not only when someone waited for it.
+	class mutex
+	{
+		std::mutex m_mutex;
+		const char* m_site;
+		time::type m_waited;
+		time::type m_acquired;
+		unsigned int m_uncontended; // counted under the lock itself
+		bool m_sampled;
+
+		void acquired()
+		{
+			if (++m_uncontended % HOLD_SAMPLING)
+				return;
+
+			m_acquired = time::now();
+			m_sampled = true;
+		}
+
+	public:
+		explicit mutex(const char* site = "std::mutex")
+			: m_site(site)
+			, m_waited(0)
+			, m_acquired(0)
+			, m_uncontended(0)
+			, m_sampled(false)
+		{}
+
+		mutex(const mutex&) = delete;
+		mutex& operator=(const mutex&) = delete;
+
+		void lock()
+		{
+			if (m_mutex.try_lock())
+			{
+				acquired();
+				return;
+			}
+
+			auto start = time::now();
+			m_mutex.lock();
+			m_acquired = time::now();
+			m_waited = m_acquired - start;
+		}
+
+		bool try_lock()
+		{
+			if (!m_mutex.try_lock())
+				return false;
+
+			acquired();
+			return true;
+		}
+
+		void unlock()
+		{
+			auto acquired = m_acquired;
+			auto waited = m_waited;
+			auto sampled = m_sampled;
+			if (!acquired)
+			{
+				m_mutex.unlock();
+				return;
+			}
+
+			auto held = time::now() - acquired;
+			m_acquired = m_waited = 0;
+			m_sampled = false;
+			m_mutex.unlock();
+
+			// recorded outside the lock, not to inflate the next hold
+			if (sampled)
+			{
+				collecting::probe::record(m_site, m_site, "hold (sampled)", ECallFlag_LOCK_HOLD, held);
+				return;
+			}
+
+			collecting::probe::record(m_site, m_site, "wait", ECallFlag_LOCK_WAIT, waited);
+			collecting::probe::record(m_site, m_site, "hold", ECallFlag_LOCK_HOLD, held);
+		}
+
+		std::mutex& native() { return m_mutex; }
+	};
+
+	// Shared acquisitions may overlap, so only their waits are recorded;
+	// exclusive ones behave like mt::mutex. Built on shared_timed_mutex,
+	// which C++14 has already.
+	class shared_mutex
+	{
+		std::shared_timed_mutex m_mutex;
+		const char* m_site;
+		time::type m_waited;
+		time::type m_acquired;
+		unsigned int m_uncontended; // exclusive ones, counted under the lock itself
+		bool m_sampled;
+
+		void acquired()
+		{
+			if (++m_uncontended % HOLD_SAMPLING)
+				return;
+
+			m_acquired = time::now();
+			m_sampled = true;
+		}
+
+	public:
+		explicit shared_mutex(const char* site = "std::shared_timed_mutex")
+			: m_site(site)
+			, m_waited(0)
+			, m_acquired(0)
+			, m_uncontended(0)
+			, m_sampled(false)
+		{}
+
+		shared_mutex(const shared_mutex&) = delete;
+		shared_mutex& operator=(const shared_mutex&) = delete;
+
+		void lock()
+		{
+			if (m_mutex.try_lock())
+			{
+				acquired();
+				return;
+			}
+
+			auto start = time::now();
+			m_mutex.lock();
+			m_acquired = time::now();
+			m_waited = m_acquired - start;
+		}
+
+		bool try_lock()
+		{
+			if (!m_mutex.try_lock())
+				return false;
+
+			acquired();
+			return true;
+		}
+
+		void unlock()
+		{
+			auto acquired = m_acquired;
+			auto waited = m_waited;
+			auto sampled = m_sampled;
+			if (!acquired)
+			{
+				m_mutex.unlock();
+				return;
+			}
+
+			auto held = time::now() - acquired;
+			m_acquired = m_waited = 0;
+			m_sampled = false;
+			m_mutex.unlock();
+
+			if (sampled)
+			{
+				collecting::probe::record(m_site, m_site, "hold (sampled)", ECallFlag_LOCK_HOLD, held);
+				return;
+			}
+
+			collecting::probe::record(m_site, m_site, "wait", ECallFlag_LOCK_WAIT, waited);
+			collecting::probe::record(m_site, m_site, "hold", ECallFlag_LOCK_HOLD, held);
+		}
+
+		void lock_shared()
+		{
+			if (m_mutex.try_lock_shared())
+				return;
+
+			auto start = time::now();
+			m_mutex.lock_shared();
+			collecting::probe::record(m_site, m_site, "wait (shared)", ECallFlag_LOCK_WAIT, time::now() - start);
+		}
+
+		bool try_lock_shared()
+		{
+			return m_mutex.try_lock_shared();
+		}
+
+		void unlock_shared()
+		{
+			m_mutex.unlock_shared();
+		}
+
+		std::shared_timed_mutex& native() { return m_mutex; }
+	};
+
+	// Time spent waiting for a notification is recorded as "<site>/wait"
+	// with ECallFlag_COND_WAIT. Re-taking the mutex on wake-up is left out
+	// of it, as mt::mutex reports that as a lock wait already.
+	class condition_variable
+	{
+		std::condition_variable_any m_cond;
+		const char* m_site;
+
+		// waited on in place of the lock, to see when it is taken again
+		template <typename Lock>
+		struct timed
+		{
+			const char* m_site;
+			Lock& m_lock;
+			time::type m_start;
+			time::type m_relocking;
+
+			timed(const char* site, Lock& lock): m_site(site), m_lock(lock), m_start(time::now()), m_relocking(0) {}
+			~timed()
+			{
+				auto spent = time::now() - m_start;
+				collecting::probe::record(m_site, m_site, "wait", ECallFlag_COND_WAIT, spent > m_relocking ? spent - m_relocking : 0);
+			}
+
+			void unlock() { m_lock.unlock(); }
+			void lock()
+			{
+				auto start = time::now();
+				m_lock.lock();
+				m_relocking += time::now() - start;
+			}
+		};
+
+	public:
+		explicit condition_variable(const char* site = "std::condition_variable")
+			: m_site(site)
+		{}
+
+		condition_variable(const condition_variable&) = delete;
+		condition_variable& operator=(const condition_variable&) = delete;
+
+		void notify_one() { m_cond.notify_one(); }
+		void notify_all() { m_cond.notify_all(); }
+
+		template <typename Lock>
+		void wait(Lock& lock)
+		{
+			timed<Lock> probe(m_site, lock);
+			m_cond.wait(probe);
+		}
+
+		template <typename Lock, typename Predicate>
+		void wait(Lock& lock, Predicate pred)
+		{
+			timed<Lock> probe(m_site, lock);
+			m_cond.wait(probe, pred);
+		}
+
+		template <typename Lock, typename Rep, typename Period>
+		std::cv_status wait_for(Lock& lock, const std::chrono::duration<Rep, Period>& rel_time)
+		{
+			timed<Lock> probe(m_site, lock);
+			return m_cond.wait_for(probe, rel_time);
+		}
+
+		template <typename Lock, typename Rep, typename Period, typename Predicate>
+		bool wait_for(Lock& lock, const std::chrono::duration<Rep, Period>& rel_time, Predicate pred)
+		{
+			timed<Lock> probe(m_site, lock);
+			return m_cond.wait_for(probe, rel_time, pred);
+		}
+
+		template <typename Lock, typename Clock, typename Duration>
+		std::cv_status wait_until(Lock& lock, const std::chrono::time_point<Clock, Duration>& abs_time)
+		{
+			timed<Lock> probe(m_site, lock);
+			return m_cond.wait_until(probe, abs_time);
+		}
+
+		template <typename Lock, typename Clock, typename Duration, typename Predicate>
+		bool wait_until(Lock& lock, const std::chrono::time_point<Clock, Duration>& abs_time, Predicate pred)
+		{
+			timed<Lock> probe(m_site, lock);
+			return m_cond.wait_until(probe, abs_time, pred);
+		}
+	};
+
+#else
+
+	class mutex: public std::mutex
+	{
+	public:
+		explicit mutex(const char* = nullptr) {}
+	};
+
+	class shared_mutex: public std::shared_timed_mutex
+	{
+	public:
+		explicit shared_mutex(const char* = nullptr) {}
+	};
+
+	class condition_variable: public std::condition_variable_any
+	{
+	public:
+		explicit condition_variable(const char* = nullptr) {}
+	};
+
+#endif // FEATURE_IO_WRITE
+
+}} // profile::mt
+
+#endif // __MUTEX_HPP__
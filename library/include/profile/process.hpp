@@ -0,0 +1,25 @@
+#ifndef __PROCESS_HPP__
+#define __PROCESS_HPP__
+
+#ifdef FEATURE_IO_WRITE
+
+namespace profile { namespace process {
+
+	unsigned int id();
+	unsigned int parent();
+
+	// True in a child of the profiled process. The writers then add the
+	// pid to the file name, e.g. "out.1234.count" instead of "out.count",
+	// so the processes of a prefork server do not overwrite each other;
+	// io::binary_merge puts them back together.
+	bool forked();
+
+	// Called by the first session. Installs the fork() handlers of
+	// collecting::session; false, where there is no fork().
+	bool watch_forks();
+
+}} // profile::process
+
+#endif // FEATURE_IO_WRITE
+
+#endif // __PROCESS_HPP__
@@ -1,8 +1,11 @@
 #ifndef __PROFILE_HPP__
 #define __PROFILE_HPP__
 
+#include <algorithm>
 #include <deque>
+#include <vector>
 #include "ticker.hpp"
+#include "counters.hpp"
 
 #ifdef FEATURE_MT_ENABLED
 #include <atomic>
@@ -11,7 +14,7 @@
 
 namespace profile
 {
-	typedef unsigned int call_id;
+	typedef unsigned long long call_id; // busy processes make more than 4 billion calls
 	typedef unsigned int function_id;
 
 	template <typename string_t>
@@ -86,7 +89,54 @@ namespace profile
 
 	enum ECallFlag
 	{
-		ECallFlag_SYSCALL = 1
+		ECallFlag_SYSCALL = 1,
+		ECallFlag_SAMPLED = 2,
+		ECallFlag_LOCK_WAIT = 4,
+		ECallFlag_LOCK_HOLD = 8,
+		ECallFlag_COND_WAIT = 16,
+		ECallFlag_IO = 32,
+		ECallFlag_QUEUE_WAIT = 64, // from submitting a task until it started
+		ECallFlag_TASK = 128       // run on another thread than its parent
+	};
+
+	enum EIoOp
+	{
+		EIoOp_READ,
+		EIoOp_WRITE,
+		EIoOp_SEND,
+		EIoOp_RECV,
+		EIoOp_FSYNC
+	};
+
+	enum EFdClass
+	{
+		EFdClass_UNKNOWN,
+		EFdClass_FILE,
+		EFdClass_PIPE,
+		EFdClass_SOCKET,
+		EFdClass_TTY,
+		EFdClass_DEVICE
+	};
+
+	enum EAttribute
+	{
+		EAttribute_U64,
+		EAttribute_TAG
+	};
+
+	// how much of a section the probes keep, see governor.hpp
+	enum ERecording
+	{
+		ERecording_FULL,
+		ERecording_COUNTED, // calls timed, but only counted in the aggregate
+		ERecording_SAMPLED  // one call in rate() kept, the rest not even timed
+	};
+
+	enum EAdmit
+	{
+		EAdmit_KEEP,
+		EAdmit_COUNT,
+		EAdmit_SKIP
 	};
 
 #ifdef FEATURE_MT_ENABLED
@@ -104,11 +154,37 @@ namespace profile
 				while (_lock.exchange(true)) {}
 			}
 
+			bool try_lock()
+			{
+				return !_lock.exchange(true);
+			}
+
 			void unlock()
 			{
 				_lock = false;
 			}
 		};
+
+		// copies as a new, unlocked lock, so whatever it guards can be copied
+		class copyable_lock: public spin_lock
+		{
+		public:
+			copyable_lock() {}
+			copyable_lock(const copyable_lock&): spin_lock() {}
+			copyable_lock& operator=(const copyable_lock&) { return *this; }
+		};
+
+		// a switch read by the probes outside of the barrier, copied by its value
+		class copyable_flag
+		{
+			std::atomic<bool> m_on;
+		public:
+			copyable_flag(bool on = false): m_on(on) {}
+			copyable_flag(const copyable_flag& rhs): m_on(rhs.m_on.load()) {}
+			copyable_flag& operator=(const copyable_flag& rhs) { m_on = rhs.m_on.load(); return *this; }
+			copyable_flag& operator=(bool on) { m_on = on; return *this; }
+			operator bool() const { return m_on; }
+		};
 	}
 
 #endif // FEATURE_MT_ENABLED
@@ -122,51 +198,294 @@ namespace profile
 			function_id  m_fn;
 			unsigned int m_flags;
 			time::type   m_duration;
+			time::type   m_self;
 
 #ifdef FEATURE_IO_READ
 			template <typename string_t>
 			friend class section_type;
 
-			call(call_id call, call_id parent, function_id fn, unsigned int flags, time::type duration);
+			call(call_id call, call_id parent, function_id fn, unsigned int flags, time::type duration, time::type self);
 #endif // FEATURE_IO_READ
 
 		public:
+			// the self time of calls still open, or read from older files
+			static const time::type NO_SELF = ~0ull;
+
 			call(call_id call, function_id fn, unsigned int flags = 0);
 			void set_parent(call_id parent);
+			void set_duration(time::type duration);
+			void set_self(time::type self);
 
 			call_id id() const { return m_call; }
 			call_id parent() const { return m_parent; }
 			function_id function() const { return m_fn; }
 			unsigned int flags() const { return m_flags; }
 			bool isSysCall() const { return m_flags & ECallFlag_SYSCALL; }
+			bool isSampled() const { return m_flags & ECallFlag_SAMPLED; }
+			bool isIO() const { return m_flags & ECallFlag_IO; }
 			time::type duration() const { return m_duration; }
+			time::type self() const { return m_self; } // less the time of the direct children
+			bool hasSelf() const { return m_self != NO_SELF; }
 
 			void start();
 			void stop();
 		};
 
-		function_id next_section();
-		call_id next_call();
+		// where a section keeps its calls
+		template <typename string_t>
+		class call_storage: public impl::container<collecting::call>
+		{
+		public:
+			explicit call_storage(function_id) {}
+		};
+
+#ifdef FEATURE_COMPACT_CALLS
+		// The calls of one section as a stream of LEB128 varints: the id
+		// as a difference from the previous one, the distance back to the
+		// parent, the flags, the duration and the time of the children.
+		// The function is the one of the section. A call takes 5 to 13
+		// bytes (LONGEST at most) instead of the 40 of a collecting::call,
+		// and is expanded again only when read, e.g. by the writers.
+		// Nothing can point into the stream, so the probes keep their calls
+		// until finished and add them only then.
+		class compact_calls
+		{
+			enum
+			{
+				CHUNK = 4096,
+				LONGEST = 45 // 10 + 10 + 5 + 10 + 10 bytes
+			};
+
+			typedef std::vector<unsigned char> chunk;
+
+			std::deque<chunk> m_chunks;
+			size_t m_size;
+			call_id m_last;
+			function_id m_fn;
+
+			static void put(chunk& out, unsigned long long value)
+			{
+				while (value > 0x7F)
+				{
+					out.push_back((unsigned char) (value | 0x80));
+					value >>= 7;
+				}
+				out.push_back((unsigned char) value);
+			}
+
+			static unsigned long long get(const unsigned char*& in)
+			{
+				unsigned long long value = 0;
+				int shift = 0;
+				while (*in & 0x80)
+				{
+					value |= (unsigned long long) (*in++ & 0x7F) << shift;
+					shift += 7;
+				}
+				return value | (unsigned long long) *in++ << shift;
+			}
+
+			static unsigned long long zigzag(long long value) { return ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63); }
+			static long long unzigzag(unsigned long long value) { return (long long) (value >> 1) ^ -(long long) (value & 1); }
+
+		public:
+			class const_iterator
+			{
+				const compact_calls* m_owner;
+				size_t m_chunk;
+				size_t m_offset;
+				size_t m_next;
+				collecting::call m_call;
+
+				void decode(call_id prev)
+				{
+					if (m_chunk == m_owner->m_chunks.size())
+						return;
+
+					auto& data = m_owner->m_chunks[m_chunk];
+					auto start = &data[m_offset];
+					auto in = start;
+
+					call_id id = (call_id) (prev + unzigzag(get(in)));
+					auto parent = get(in);
+					m_call = collecting::call(id, m_owner->m_fn, (unsigned int) get(in));
+					m_call.set_parent(parent ? (call_id) (id - unzigzag(parent - 1)) : 0);
+					m_call.set_duration(get(in));
+					auto children = get(in);
+					m_call.set_self(children ? m_call.duration() - (children - 1) : collecting::call::NO_SELF);
+
+					m_next = m_offset + (in - start);
+				}
+
+			public:
+				typedef std::forward_iterator_tag iterator_category;
+				typedef collecting::call value_type;
+				typedef ptrdiff_t difference_type;
+				typedef const collecting::call* pointer;
+				typedef const collecting::call& reference;
+
+				const_iterator(const compact_calls* owner, size_t chunk)
+					: m_owner(owner)
+					, m_chunk(chunk)
+					, m_offset(0)
+					, m_next(0)
+					, m_call(0, 0)
+				{
+					decode(0);
+				}
+
+				reference operator*() const { return m_call; }
+				pointer operator->() const { return &m_call; }
+
+				const_iterator& operator++()
+				{
+					m_offset = m_next;
+					if (m_offset == m_owner->m_chunks[m_chunk].size())
+					{
+						++m_chunk;
+						m_offset = 0;
+					}
+					decode(m_call.id());
+					return *this;
+				}
+
+				bool operator==(const const_iterator& rhs) const { return m_chunk == rhs.m_chunk && m_offset == rhs.m_offset; }
+				bool operator!=(const const_iterator& rhs) const { return !(*this == rhs); }
+			};
+
+			explicit compact_calls(function_id fn): m_size(0), m_last(0), m_fn(fn) {}
+
+			const_iterator begin() const { return const_iterator(this, 0); }
+			const_iterator end() const { return const_iterator(this, m_chunks.size()); }
+			size_t size() const { return m_size; }
+
+			void push_back(const collecting::call& c)
+			{
+				if (m_chunks.empty() || m_chunks.back().size() + LONGEST > CHUNK)
+				{
+					m_chunks.emplace_back();
+					m_chunks.back().reserve(CHUNK);
+				}
+
+				auto& out = m_chunks.back();
+				put(out, zigzag((long long) c.id() - (long long) m_last));
+				put(out, c.parent() ? zigzag((long long) c.id() - (long long) c.parent()) + 1 : 0);
+				put(out, c.flags());
+				put(out, c.duration());
+				put(out, c.hasSelf() ? c.duration() - c.self() + 1 : 0);
+
+				m_last = c.id();
+				++m_size;
+			}
+
+			void clear()
+			{
+				m_chunks.clear();
+				m_size = 0;
+				m_last = 0;
+			}
+
+			void swap(compact_calls& rhs)
+			{
+				m_chunks.swap(rhs.m_chunks);
+				std::swap(m_size, rhs.m_size);
+				std::swap(m_last, rhs.m_last);
+			}
+		};
+
+		template <>
+		class call_storage<const char*>
+		{
+		public:
+			typedef compact_calls items;
+			typedef items::const_iterator const_iterator;
+
+			explicit call_storage(function_id fn): m_items(fn) {}
+
+			const_iterator begin() const { return m_items.begin(); }
+			const_iterator end() const { return m_items.end(); }
+
+		protected:
+			items m_items;
+		};
+#endif // FEATURE_COMPACT_CALLS
+
+		// Calls settled within a latency budget are only counted here and
+		// never kept; the calls over the budget are kept as usual and
+		// counted as violations.
+		struct aggregate
+		{
+			unsigned long long calls;
+			time::type duration;
+			time::type self;
+			time::type longest;
+			unsigned long long violations;
+			unsigned long long skipped; // neither kept nor timed
+
+			aggregate(): calls(0), duration(0), self(0), longest(0), violations(0), skipped(0) {}
+
+			bool empty() const { return !calls && !violations && !skipped; }
+
+			void add(time::type d, time::type s)
+			{
+				++calls;
+				duration += d;
+				self += s;
+				if (longest < d)
+					longest = d;
+			}
+
+			void violated(time::type d)
+			{
+				++violations;
+				if (longest < d)
+					longest = d;
+			}
+
+			void merge(const aggregate& rhs)
+			{
+				calls += rhs.calls;
+				duration += rhs.duration;
+				self += rhs.self;
+				violations += rhs.violations;
+				skipped += rhs.skipped;
+				if (longest < rhs.longest)
+					longest = rhs.longest;
+			}
+		};
 
 		template <typename string_t>
-		class section_type: public impl::container<collecting::call>
+		class section_type: public call_storage<string_t>
 		{
 			string_t m_name;
 			function_id m_id;
+			collecting::aggregate m_aggregate;
+			ERecording m_recording;
+			unsigned int m_rate;
+			unsigned long long m_sequence;
+			unsigned long long m_kept;    // since reset_hits()
+			unsigned long long m_counted; // since reset_hits()
+			unsigned long long m_skipped; // since reset_hits()
 
 		public:
 			typedef typename string_ref<string_t>::type string_arg;
 
-			section_type(string_arg name)
-				: m_name(name)
-				, m_id(next_section())
+			section_type(string_arg name, function_id id)
+				: call_storage<string_t>(id)
+				, m_name(name)
+				, m_id(id)
+				, m_recording(ERecording_FULL)
+				, m_rate(1)
+				, m_sequence(0)
+				, m_kept(0)
+				, m_counted(0)
+				, m_skipped(0)
 			{}
 
 			string_arg name() const { return m_name; }
 			function_id id() const { return m_id; }
-			collecting::call& call(unsigned int flags = 0)
+			collecting::call& call(call_id id, unsigned int flags = 0)
 			{
-				call_id id = next_call();
 				m_items.emplace_back(id, m_id, flags);
 				return m_items.back();
 			}
@@ -183,20 +502,105 @@ namespace profile
 				}
 			}
 
+			void add(const collecting::call& c)
+			{
+				m_items.push_back(c);
+			}
+
+			// moves the calls and the aggregate into an empty section
+			// of the same id; the governor keeps counting the hits
+			void move_to(section_type& out)
+			{
+				out.m_items.swap(m_items);
+				out.m_aggregate = m_aggregate;
+				m_aggregate = collecting::aggregate();
+			}
+
+			// lends the calls to an empty section of the same id, with a
+			// copy of the aggregate, see profile_type::lend()
+			void lend_to(section_type& out)
+			{
+				out.m_items.swap(m_items);
+				out.m_aggregate = m_aggregate;
+			}
+
+			// the calls lent come back ahead of the ones added since, and
+			// stay where they were, for the probes still pointing at them
+			void take_back(section_type& from)
+			{
+				for (auto& c : m_items)
+					from.m_items.push_back(c);
+				m_items.swap(from.m_items);
+			}
+
+			size_t size() const { return m_items.size(); }
+
+			// drops the calls and everything counted about them
+			void clear()
+			{
+				m_items.clear();
+				m_aggregate = collecting::aggregate();
+				reset_hits();
+			}
+
+			const collecting::aggregate& aggregate() const { return m_aggregate; }
+			collecting::aggregate& aggregate() { return m_aggregate; }
+
+			ERecording recording() const { return m_recording; }
+			unsigned int rate() const { return m_rate; }
+			unsigned long long kept() const { return m_kept; }
+			unsigned long long counted() const { return m_counted; }
+			unsigned long long skipped() const { return m_skipped; }
+			void reset_hits() { m_kept = m_counted = m_skipped = 0; }
+
+			// what to do with the next call; a call which must be timed is
+			// counted rather than skipped
+			EAdmit admit(bool timed = false)
+			{
+				switch (m_recording)
+				{
+				case ERecording_COUNTED:
+					++m_counted;
+					return EAdmit_COUNT;
+				case ERecording_SAMPLED:
+					if (m_sequence++ % m_rate)
+					{
+						if (timed)
+						{
+							++m_counted;
+							return EAdmit_COUNT;
+						}
+
+						++m_skipped;
+						++m_aggregate.skipped;
+						return EAdmit_SKIP;
+					}
+				default:
+					++m_kept;
+					return EAdmit_KEEP;
+				}
+			}
+
+			void downgrade(unsigned int rate)
+			{
+				if (m_recording == ERecording_FULL)
+					m_recording = ERecording_COUNTED;
+				else
+				{
+					m_recording = ERecording_SAMPLED;
+					m_rate = rate;
+				}
+			}
+
 #ifdef FEATURE_IO_READ
 		private:
 			friend class io::reader;
 			template <typename string_t>
 			friend class function_type;
 
-			section_type(string_arg name, function_id id)
-				: m_name(name)
-				, m_id(id)
-			{}
-
-			void add_call(call_id call, call_id parent, unsigned int flags, time::type duration)
+			void add_call(call_id call, call_id parent, unsigned int flags, time::type duration, time::type self)
 			{
-				m_items.push_back(collecting::call(call, parent, m_id, flags, duration));
+				m_items.push_back(collecting::call(call, parent, m_id, flags, duration, self));
 			}
 #endif // FEATURE_IO_READ
 		};
@@ -207,8 +611,8 @@ namespace profile
 			string_t m_name;
 			string_t m_nice;
 
-#ifdef FEATURE_IO_READ
-			friend class io::reader;
+			template <typename>
+			friend class profile_type;
 
 			section_type<string_t>& add_section(string_arg name, function_id id)
 			{
@@ -222,6 +626,9 @@ namespace profile
 				return m_items.back();
 			}
 
+#ifdef FEATURE_IO_READ
+			friend class io::reader;
+
 			items& items() { return m_items; }
 #endif // FEATURE_IO_READ
 
@@ -230,29 +637,701 @@ namespace profile
 				: m_name(name)
 				, m_nice(nice)
 			{}
-			section_type<string_t>& section(string_arg name) { return locate(name); }
+			// a new section takes the next id after last_id
+			section_type<string_t>& section(string_arg name, function_id& last_id)
+			{
+				for (auto& i : m_items)
+				{
+					if (string_ref<string_t>::equals(i.name(), name))
+						return i;
+				}
+
+				m_items.emplace_back(name, ++last_id);
+				return m_items.back();
+			}
+
+			template <typename F>
+			void sections(F f)
+			{
+				for (auto& s : m_items)
+					f(s);
+			}
 
 			string_arg name() const { return m_name; }
 			string_arg nice() const { return m_nice; }
 		};
 
+		template <typename string_t>
+		class attribute_type
+		{
+			call_id m_call;
+			string_t m_name;
+			EAttribute m_type;
+			unsigned long long m_value;
+			string_t m_tag;
+
+		public:
+			typedef typename string_ref<string_t>::type string_arg;
+
+			attribute_type(call_id call, string_arg name, unsigned long long value)
+				: m_call(call)
+				, m_name(name)
+				, m_type(EAttribute_U64)
+				, m_value(value)
+				, m_tag()
+			{}
+
+			attribute_type(call_id call, string_arg name, string_arg tag)
+				: m_call(call)
+				, m_name(name)
+				, m_type(EAttribute_TAG)
+				, m_value(0)
+				, m_tag(tag)
+			{}
+
+			call_id call() const { return m_call; }
+			string_arg name() const { return m_name; }
+			EAttribute type() const { return m_type; }
+			bool isTag() const { return m_type == EAttribute_TAG; }
+			unsigned long long value() const { return m_value; }
+			string_arg tag() const { return m_tag; }
+		};
+
+		// side table keyed by call id, so calls without attributes
+		// do not pay for them
+		template <typename string_t>
+		class attributes_type: public impl::container<attribute_type<string_t>>
+		{
+		public:
+			typedef typename string_ref<string_t>::type string_arg;
+
+			void add(call_id call, string_arg name, unsigned long long value) { m_items.emplace_back(call, name, value); }
+			void add(call_id call, string_arg name, string_arg tag) { m_items.emplace_back(call, name, tag); }
+			bool empty() const { return m_items.empty(); }
+			void append(const attributes_type& rhs) { m_items.insert(m_items.end(), rhs.m_items.begin(), rhs.m_items.end()); }
+		};
+
+		class io_stats
+		{
+		public:
+			enum { BUCKETS = 32 }; // log2 of the transfer size, the last one is open-ended
+
+		private:
+			function_id m_fn;
+			EIoOp m_op;
+			EFdClass m_fd;
+			unsigned long long m_calls;
+			unsigned long long m_bytes;
+			time::type m_duration;
+			unsigned long long m_histogram[BUCKETS];
+
+		public:
+			io_stats(function_id fn, EIoOp op, EFdClass fd)
+				: m_fn(fn)
+				, m_op(op)
+				, m_fd(fd)
+				, m_calls(0)
+				, m_bytes(0)
+				, m_duration(0)
+			{
+				for (auto& bucket : m_histogram)
+					bucket = 0;
+			}
+
+			static unsigned int bucket(unsigned long long bytes)
+			{
+				unsigned int ret = 0;
+				while (bytes && ret < BUCKETS - 1)
+				{
+					bytes >>= 1;
+					++ret;
+				}
+				return ret;
+			}
+
+			void add(unsigned long long bytes, time::type duration)
+			{
+				++m_calls;
+				m_bytes += bytes;
+				m_duration += duration;
+				++m_histogram[bucket(bytes)];
+			}
+
+			void merge(unsigned long long calls, unsigned long long bytes, time::type duration, const unsigned long long* histogram)
+			{
+				m_calls += calls;
+				m_bytes += bytes;
+				m_duration += duration;
+				for (int i = 0; i < BUCKETS; ++i)
+					m_histogram[i] += histogram[i];
+			}
+
+			function_id function() const { return m_fn; }
+			EIoOp op() const { return m_op; }
+			EFdClass fdClass() const { return m_fd; }
+			unsigned long long calls() const { return m_calls; }
+			unsigned long long bytes() const { return m_bytes; }
+			time::type duration() const { return m_duration; }
+			const unsigned long long* histogram() const { return m_histogram; }
+		};
+
+		class io_stats_table: public impl::container<io_stats>
+		{
+		public:
+			io_stats& locate(function_id fn, EIoOp op, EFdClass fd)
+			{
+				for (auto& i : m_items)
+				{
+					if (i.function() == fn && i.op() == op && i.fdClass() == fd)
+						return i;
+				}
+
+				m_items.emplace_back(fn, op, fd);
+				return m_items.back();
+			}
+
+			bool empty() const { return m_items.empty(); }
+		};
+
+		struct stack_frame
+		{
+			call_id call;
+			function_id function;
+		};
+
+		// a probe found open for too long, with all the probes around it
+		class stall
+		{
+			unsigned int m_thread;
+			time::type m_observed;
+			time::type m_open;
+			std::vector<stack_frame> m_stack; // outermost first
+
+		public:
+			stall(unsigned int thread, time::type observed, time::type open)
+				: m_thread(thread)
+				, m_observed(observed)
+				, m_open(open)
+			{}
+
+			void push(call_id call, function_id fn)
+			{
+				stack_frame frame = { call, fn };
+				m_stack.push_back(frame);
+			}
+
+			unsigned int thread() const { return m_thread; }
+			time::type observed() const { return m_observed; }
+			time::type open() const { return m_open; }
+			const std::vector<stack_frame>& stack() const { return m_stack; }
+		};
+
+		class stalls_type: public impl::container<stall>
+		{
+		public:
+			void add(const stall& s) { m_items.push_back(s); }
+			bool empty() const { return m_items.empty(); }
+		};
+
+		// a budgeted call, which took longer than it was allowed to
+		class violation
+		{
+			call_id m_call;
+			function_id m_fn;
+			time::type m_duration;
+			time::type m_budget;
+			std::vector<stack_frame> m_stack; // outermost first
+			std::vector<stack_frame> m_children;
+
+		public:
+			violation(call_id call, function_id fn, time::type duration, time::type budget)
+				: m_call(call)
+				, m_fn(fn)
+				, m_duration(duration)
+				, m_budget(budget)
+			{}
+
+			void push(call_id call, function_id fn)
+			{
+				stack_frame frame = { call, fn };
+				m_stack.push_back(frame);
+			}
+
+			void child(call_id call, function_id fn)
+			{
+				stack_frame frame = { call, fn };
+				m_children.push_back(frame);
+			}
+
+			call_id call() const { return m_call; }
+			function_id function() const { return m_fn; }
+			time::type duration() const { return m_duration; }
+			time::type budget() const { return m_budget; }
+			const std::vector<stack_frame>& stack() const { return m_stack; }
+			const std::vector<stack_frame>& children() const { return m_children; }
+		};
+
+		class violations_type: public impl::container<violation>
+		{
+		public:
+			void add(const violation& v) { m_items.push_back(v); }
+			bool empty() const { return m_items.empty(); }
+		};
+
+		// a section the overhead governor switched to cheaper recording
+		class downgrade
+		{
+			function_id m_fn;
+			ERecording m_recording;
+			unsigned int m_rate;
+			time::type m_at;     // since the governor started
+			unsigned long long m_hits;
+			time::type m_window; // in which the hits were seen
+
+		public:
+			downgrade(function_id fn, ERecording recording, unsigned int rate, time::type at, unsigned long long hits, time::type window)
+				: m_fn(fn)
+				, m_recording(recording)
+				, m_rate(rate)
+				, m_at(at)
+				, m_hits(hits)
+				, m_window(window)
+			{}
+
+			function_id function() const { return m_fn; }
+			ERecording recording() const { return m_recording; }
+			unsigned int rate() const { return m_rate; }
+			time::type at() const { return m_at; }
+			unsigned long long hits() const { return m_hits; }
+			time::type window() const { return m_window; }
+		};
+
+		class downgrades_type: public impl::container<downgrade>
+		{
+		public:
+			void add(const downgrade& d) { m_items.push_back(d); }
+			bool empty() const { return m_items.empty(); }
+		};
+
+		// the calls of one process, in a file written by it or merged
+		class process
+		{
+			unsigned int m_pid;
+			unsigned int m_parent;
+			call_id m_first;
+			call_id m_last;
+
+		public:
+			process(unsigned int pid, unsigned int parent, call_id first, call_id last)
+				: m_pid(pid)
+				, m_parent(parent)
+				, m_first(first)
+				, m_last(last)
+			{}
+
+			unsigned int pid() const { return m_pid; }
+			unsigned int parent() const { return m_parent; }
+			call_id first() const { return m_first; }
+			call_id last() const { return m_last; }
+			bool owns(call_id call) const { return call >= m_first && call <= m_last; }
+		};
+
+		class processes_type: public impl::container<process>
+		{
+		public:
+			void add(const process& p) { m_items.push_back(p); }
+			bool empty() const { return m_items.empty(); }
+		};
+
+		struct probe;
+
 		template <typename string_t>
 		class profile_type: public impl::findable_container<function_type<string_t>, string_t>
 		{
+			attributes_type<string_t> m_attributes;
+			io_stats_table m_io;
+			stalls_type m_stalls;
+			violations_type m_violations;
+			downgrades_type m_downgrades;
+			processes_type m_processes;
+			std::deque<std::pair<string_t, time::type>> m_budgets;
+#ifdef FEATURE_MT_ENABLED
+			mt::copyable_flag m_governed; // read by every probe, see governor.hpp
+#else
+			bool m_governed;
+#endif // FEATURE_MT_ENABLED
+			function_id m_last_section;
+			call_id m_last_call;
+
+			friend struct probe;
+
+		protected:
+#ifdef FEATURE_MT_ENABLED
+			mutable mt::copyable_lock m_barrier;
+			mt::spin_lock& barrier() const { return m_barrier; }
+
+			// taken by lend() and cut(), for as long as the calls are away
+			static std::mutex& writers()
+			{
+				static std::mutex _;
+				return _;
+			}
+#endif // FEATURE_MT_ENABLED
+
+			// with the barrier taken
+			call_id next_call() { return ++m_last_call; }
+			void set_last_call(call_id last) { m_last_call = last; }
+			section_type<string_t>& section(string_arg name, string_arg nice, string_arg suffix) { return function(name, nice).section(suffix, m_last_section); }
+
+			// With the barrier taken. Unlike reset(), keeps the functions
+			// and the ids, so the ids given before are never given again.
+			void clear_calls()
+			{
+				for (auto& f : m_items)
+					f.sections([](section_type<string_t>& s) { s.clear(); });
+
+				m_attributes = attributes_type<string_t>();
+				m_io = io_stats_table();
+				m_stalls = stalls_type();
+				m_violations = violations_type();
+				m_downgrades = downgrades_type();
+				m_processes = processes_type();
+			}
+
+			section_type<string_t>* find_section(function_id id)
+			{
+				section_type<string_t>* found = nullptr;
+				for (auto& f : m_items)
+				{
+					f.sections([&](section_type<string_t>& s) {
+						if (s.id() == id)
+							found = &s;
+					});
+				}
+				return found;
+			}
+
 		public:
+			profile_type()
+				: m_governed(false)
+				, m_last_section(0)
+				, m_last_call(0)
+			{}
+
 			function_type<string_t>& function(string_arg name, string_arg nice) { return locate(name, nice); }
 
 			collecting::call& call(string_arg name, string_arg nice, string_arg suffix, unsigned int flags = 0)
 			{
 #ifdef FEATURE_MT_ENABLED
-				static mt::spin_lock barrier;
-				std::lock_guard<mt::spin_lock> guard(barrier);
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				return section(name, nice, suffix).call(next_call(), flags);
+			}
+			void update(string_arg name, string_arg nice, string_arg suffix, const collecting::call& c) { section(name, nice, suffix).update(c); }
+
+			// a finished call, filled in under the lock
+			call_id call(string_arg name, string_arg nice, string_arg suffix, unsigned int flags, call_id parent, time::type duration, time::type self)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				auto& s = section(name, nice, suffix);
+				collecting::call c(next_call(), s.id(), flags);
+				c.set_parent(parent);
+				c.set_duration(duration);
+				c.set_self(self);
+				s.add(c);
+				return c.id();
+			}
+
+			// a copy taken under the lock, for the writers
+			profile_type snapshot() const
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				return *this;
+			}
+
+			// For the writers, which walk the profile without the lock and
+			// without copying the calls: they are moved into a profile of
+			// their own, given to f, and moved back ahead of the ones added
+			// meanwhile. The lock is held while the tables other than the
+			// calls and the attributes are copied, and again while the calls
+			// and the attributes added during f are copied behind the ones
+			// lent, so the probes wait for about as long as a snapshot of
+			// what f was not given would take, and not for the disk. The
+			// probes keep their calls until finished, so f sees none of the
+			// open ones. The writers wait for each other, and cut() waits
+			// for them.
+			template <typename F>
+			void lend(F f) const
+			{
+#ifdef FEATURE_MT_ENABLED
+				// nothing is changed, once f returns
+				auto& self = const_cast<profile_type&>(*this);
+
+				std::lock_guard<std::mutex> writing(writers());
+				(void)(writing);
+
+				profile_type out;
+				{
+					std::lock_guard<mt::spin_lock> guard(barrier());
+					(void)(guard);
+
+					for (auto& fn : self.m_items)
+					{
+						out.m_items.emplace_back(fn.name(), fn.nice());
+						auto& into = out.m_items.back();
+						fn.sections([&](section_type<string_t>& s) { s.lend_to(into.add_section(s.name(), s.id())); });
+					}
+
+					std::swap(out.m_attributes, self.m_attributes);
+					out.m_io = m_io;
+					out.m_stalls = m_stalls;
+					out.m_violations = m_violations;
+					out.m_downgrades = m_downgrades;
+					out.m_processes = m_processes;
+					out.m_last_section = m_last_section;
+					out.m_last_call = m_last_call;
+				}
+
+				f((const profile_type&) out);
+
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+
+				// the functions and the sections added since come after the ones lent
+				for (size_t i = 0; i < out.m_items.size(); ++i)
+				{
+					auto& from = out.m_items[i].m_items;
+					auto& into = self.m_items[i].m_items;
+					for (size_t j = 0; j < from.size(); ++j)
+						into[j].take_back(from[j]);
+				}
+
+				out.m_attributes.append(self.m_attributes);
+				std::swap(out.m_attributes, self.m_attributes);
+#else
+				f(*this);
+#endif // FEATURE_MT_ENABLED
+			}
+
+			// Moves everything collected so far into a profile of its own,
+			// with the same functions; the ids go on. Only the functions are
+			// copied under the lock, the calls are moved, so the probes are
+			// not held for long. The open calls are still with their probes,
+			// see rotate.hpp.
+			profile_type cut()
+			{
+				profile_type out;
+
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<std::mutex> writing(writers());
+				(void)(writing);
+				std::lock_guard<mt::spin_lock> guard(barrier());
 				(void)(guard);
 #endif // FEATURE_MT_ENABLED
 
-				return function(name, nice).section(suffix).call(flags);
+				for (auto& f : m_items)
+				{
+					out.m_items.emplace_back(f.name(), f.nice());
+					auto& into = out.m_items.back();
+					f.sections([&](section_type<string_t>& s) { s.move_to(into.add_section(s.name(), s.id())); });
+				}
+
+				std::swap(out.m_attributes, m_attributes);
+				std::swap(out.m_io, m_io);
+				std::swap(out.m_stalls, m_stalls);
+				std::swap(out.m_violations, m_violations);
+				std::swap(out.m_downgrades, m_downgrades);
+				m_processes = processes_type();
+				out.m_last_section = m_last_section;
+				out.m_last_call = m_last_call;
+				return out;
+			}
+
+			// the largest id given so far; of the profile lent, for the writers
+			call_id last_call() const { return m_last_call; }
+
+			size_t call_count() const
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				size_t count = 0;
+				for (auto& f : m_items)
+				{
+					for (auto& s : f)
+						count += s.size();
+				}
+				return count;
+			}
+
+			// Drops everything collected so far and starts the ids over;
+			// the budgets and the governor stay. No probe may be open
+			// in the profile, as they point into it.
+			void reset()
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_items.clear();
+				m_attributes = attributes_type<string_t>();
+				m_io = io_stats_table();
+				m_stalls = stalls_type();
+				m_violations = violations_type();
+				m_downgrades = downgrades_type();
+				m_processes = processes_type();
+				m_last_section = 0;
+				m_last_call = 0;
+			}
+
+			template <typename Value>
+			void attribute(call_id call, string_arg name, Value value)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_attributes.add(call, name, value);
+			}
+			const attributes_type<string_t>& attributes() const { return m_attributes; }
+
+			void io(function_id fn, EIoOp op, EFdClass fd, unsigned long long bytes, time::type duration)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_io.locate(fn, op, fd).add(bytes, duration);
+			}
+
+			void io(function_id fn, EIoOp op, EFdClass fd, unsigned long long calls, unsigned long long bytes, time::type duration, const unsigned long long* histogram)
+			{
+				m_io.locate(fn, op, fd).merge(calls, bytes, duration, histogram);
+			}
+			const io_stats_table& io() const { return m_io; }
+
+			void add_stall(const collecting::stall& s)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_stalls.add(s);
+			}
+			const stalls_type& stalls() const { return m_stalls; }
+
+			void add_violation(const collecting::violation& v) { m_violations.add(v); }
+			const violations_type& violations() const { return m_violations; }
+
+			// budget for all the sections of that name, in ticks; zero removes it
+			void budget(string_arg section, time::type limit)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				for (auto& b : m_budgets)
+				{
+					if (string_ref<string_t>::equals(b.first, section))
+					{
+						b.second = limit;
+						return;
+					}
+				}
+
+				m_budgets.emplace_back(section, limit);
+			}
+
+			void add_downgrade(const collecting::downgrade& d) { m_downgrades.add(d); }
+			const downgrades_type& downgrades() const { return m_downgrades; }
+
+			void add_process(const collecting::process& p) { m_processes.add(p); }
+			const processes_type& processes() const { return m_processes; }
+
+			bool governed() const { return m_governed; }
+			void govern(bool on) { m_governed = on; }
+
+			// Downgrades the sections with the most expensive hits, until
+			// the estimated cost of the probes seen in the window fits
+			// within the limit (a fraction of the window); the hit counters
+			// start over afterwards. The costs are in ticks per kept,
+			// counted and skipped call.
+			void throttle(double limit, time::type at, time::type window, const time::type (&costs)[3], unsigned int rate)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				auto cost_of = [&](unsigned long long kept, unsigned long long counted, unsigned long long skipped) -> double {
+					return (double) kept * costs[EAdmit_KEEP] + (double) counted * costs[EAdmit_COUNT] + (double) skipped * costs[EAdmit_SKIP];
+				};
+
+				typedef std::pair<double, section_type<string_t>*> hot_section;
+				std::vector<hot_section> hot;
+				double cost = 0;
+				for (auto& f : m_items)
+				{
+					f.sections([&](section_type<string_t>& s) {
+						auto own = cost_of(s.kept(), s.counted(), s.skipped());
+						cost += own;
+						if (s.recording() != ERecording_SAMPLED && (s.kept() || s.counted()))
+							hot.push_back(hot_section(own, &s));
+					});
+				}
+
+				if (window && cost > limit * window)
+				{
+					std::sort(hot.begin(), hot.end(), [](const hot_section& lhs, const hot_section& rhs) { return lhs.first > rhs.first; });
+
+					for (auto& h : hot)
+					{
+						if (cost <= limit * window)
+							break;
+
+						auto s = h.second;
+						auto hits = s->kept() + s->counted() + s->skipped();
+
+						s->downgrade(rate);
+						if (s->recording() == ERecording_COUNTED)
+							cost += cost_of(0, hits, 0) - h.first;
+						else
+							cost += cost_of(hits / rate, 0, hits - hits / rate) - h.first;
+
+						m_downgrades.add(collecting::downgrade(s->id(), s->recording(), s->rate(), at, hits, window));
+					}
+				}
+
+				for (auto& f : m_items)
+					f.sections([](section_type<string_t>& s) { s.reset_hits(); });
+			}
+
+			time::type budget(string_arg section) const
+			{
+				for (auto& b : m_budgets)
+				{
+					if (string_ref<string_t>::equals(b.first, section))
+						return b.second;
+				}
+				return 0;
 			}
-			void update(string_arg name, string_arg nice, string_arg suffix, const collecting::call& c) { function(name, nice).section(suffix).update(c); }
 
 #ifdef FEATURE_IO_READ
 		private:
@@ -262,15 +1341,164 @@ namespace profile
 		};
 
 #ifdef FEATURE_IO_WRITE
+		// An independent profile, with its own functions, calls, ids, lock
+		// and output, e.g. per subsystem or per test case. Probes record
+		// into the current session of their thread, global() unless
+		// switched with a scope, or into the session given to them.
+		//
+		// After fork(), the child drops what the parent collected, and
+		// every other thread. The probes still open on the forking thread
+		// are the parent's, which records their calls: the child does not,
+		// but its calls made below them keep them as their parents. The ids
+		// of the child start at its pid shifted by FORK_SHIFT bits, so the
+		// processes of one tree never give the same id twice, and
+		// binary_merge can keep them as they are. The writers add the pid
+		// to the file names, see process.hpp.
+		class session: public profile_type<const char*>
+		{
+			void forked();
+
+		public:
+			enum { FORK_SHIFT = 40 }; // the ids of a process below that many bits
+
+			session();
+			~session();
+
+			session(const session&) = delete;
+			session& operator=(const session&) = delete;
+
+			static session& global();
+			static session& current();
+			static session* make_current(session* next); // returns the previous one
+
+			// around fork(), with every session locked in between
+			static void before_fork();
+			static void after_fork(bool child);
+
+			// For the crash handler, which cannot wait for a thread that
+			// will never run again: goes on without the lock, when it is
+			// not free after a while.
+			template <typename F>
+			void inspect(F f) const
+			{
+#ifdef FEATURE_MT_ENABLED
+				bool locked = false;
+				for (int attempt = 0; !locked && attempt < 1000; ++attempt)
+					locked = barrier().try_lock();
+#endif // FEATURE_MT_ENABLED
+
+				f(*this);
+
+#ifdef FEATURE_MT_ENABLED
+				if (locked)
+					barrier().unlock();
+#endif // FEATURE_MT_ENABLED
+			}
+
+			struct scope
+			{
+				session* m_prev;
+				scope(session& s): m_prev(make_current(&s)) {}
+				~scope() { make_current(m_prev); }
+
+				scope(const scope&) = delete;
+				scope& operator=(const scope&) = delete;
+			};
+		};
+
+		struct probe;
+
+		// What a probe like io_probe or task_probe adds to its call. Being
+		// a base constructed ahead of the probe, it does its work before the
+		// call starts, and is told about the call only once it stopped, so
+		// none of that is timed.
+		struct probe_extra
+		{
+			virtual void stopped(probe& p) = 0;
+
+		protected:
+			~probe_extra() {}
+		};
+
+		// what an io_probe moves
+		struct io_transfer: probe_extra
+		{
+			EIoOp m_op;
+			EFdClass m_fd;
+			unsigned long long m_bytes;
+
+			io_transfer(EIoOp op, EFdClass fd): m_op(op), m_fd(fd), m_bytes(0) {}
+			void stopped(probe& p);
+		};
+
+		// A probe with a latency budget, or one nested in such a probe,
+		// keeps its call to itself. When the budgeted probe finishes in
+		// time, the calls are only counted in their sections' aggregates;
+		// when it overruns, they are all kept and the overrun goes to the
+		// violation log with the open probes around it and the direct
+		// children. Memory then grows with the incidents, not the traffic.
 		struct probe
 		{
-			call& m_call;
+			struct deferred
+			{
+				section_type<const char*>* section;
+				collecting::call call;
+				bool kept; // by a nested budgeted probe, which overran
+			};
+
+			collecting::session* m_session;
 			probe* prev;
+			probe* m_outer; // the innermost enclosing probe of the same session
+			time::type m_budget;
+			probe* m_owner; // the budgeted probe this one reports to
+			section_type<const char*>* m_section;
+			EAdmit m_admit; // other than KEEP, when throttled by the governor
+			collecting::call m_call; // added to the section when finished
+			call_id m_anchor; // the parent of the calls below, skipping counted ones
+			time::type m_children; // time of the direct children
+			bool m_detached; // parented elsewhere, see task_probe; not within the time of m_outer
+			bool m_inherited; // open in the parent of a forked child, which records the call
+			std::vector<deferred> m_deferred;
+			std::vector<attribute_type<const char*>> m_attributes; // of the deferred calls
+			counters::sample m_counters; // at the start, see counters.hpp
+			probe_extra* m_extra; // told when the call stops, see io_probe
+
 			static probe*& curr();
-			static profile_type<const char*>& profile();
+			static collecting::session& profile(); // the current session
+			static call_id record(const char* name, const char* nice, const char* suffix, unsigned int flags, time::type duration);
+			static call_id anchor(const collecting::session& session); // the parent of a call made now
+			static const char* intern(const char* tag);
+			static time::type usec(unsigned long long us);
+			static void budget(const char* section, unsigned long long us);
 
-			probe(const char* name, const char* raw, const char* suffix, unsigned int flags = 0);
+			probe(const char* name, const char* raw, const char* suffix, unsigned int flags = 0, time::type budget = 0);
+			probe(collecting::session& session, const char* name, const char* raw, const char* suffix, unsigned int flags = 0, time::type budget = 0);
 			~probe();
+
+			probe& attr(const char* name, unsigned long long value);
+			probe& tag(const char* name, const char* value);
+
+		protected:
+			probe(collecting::session& session, const char* name, const char* raw, const char* suffix, unsigned int flags, time::type budget, probe_extra* extra);
+
+		private:
+			static probe* outer(probe* from, const collecting::session* session);
+			call open(const char* name, const char* nice, const char* suffix, unsigned int flags);
+			void settle();
+			void inherited();
+			void count();
+		};
+
+		// A SYSCALL_PROBE which also knows what kind of transfer it
+		// guards. The byte counts are kept per call as the "bytes"
+		// attribute and aggregated per function into io_stats.
+		struct io_probe: io_transfer, probe
+		{
+			static EFdClass classify(int fd);
+
+			io_probe(const char* name, const char* nice, const char* suffix, EIoOp op, int fd);
+
+			io_probe& bytes(unsigned long long count);
 		};
 #endif // FEATURE_IO_WRITE
 	}
@@ -280,10 +1508,36 @@ namespace profile
 #	define FUNCTION_PROBE() profile::collecting::probe __probe(__FUNCDNAME__, __FUNCSIG__, "")
 #	define SYSCALL_PROBE() profile::collecting::probe __probe(__FUNCDNAME__, __FUNCSIG__, "", profile::ECallFlag_SYSCALL)
 #	define FUNCTION_PROBE2(name, suffix) profile::collecting::probe name(__FUNCDNAME__, __FUNCSIG__, suffix)
+#	define SESSION_PROBE(session) profile::collecting::probe __probe(session, __FUNCDNAME__, __FUNCSIG__, "")
+#	define BUDGET_PROBE(us) profile::collecting::probe __probe(__FUNCDNAME__, __FUNCSIG__, "", 0, profile::collecting::probe::usec(us))
+#	define BUDGET_PROBE2(name, suffix, us) profile::collecting::probe name(__FUNCDNAME__, __FUNCSIG__, suffix, 0, profile::collecting::probe::usec(us))
+#	define PROBE_BUDGET(section, us) profile::collecting::probe::budget(section, us)
+#	define PROBE_ATTR(name, value) __probe.attr(name, value)
+#	define PROBE_TAG(name, value) __probe.tag(name, value)
+#	define IO_PROBE(op, fd) profile::collecting::io_probe __probe(__FUNCDNAME__, __FUNCSIG__, "", profile::EIoOp_##op, fd)
+#	define READ_PROBE(fd) IO_PROBE(READ, fd)
+#	define WRITE_PROBE(fd) IO_PROBE(WRITE, fd)
+#	define SEND_PROBE(fd) IO_PROBE(SEND, fd)
+#	define RECV_PROBE(fd) IO_PROBE(RECV, fd)
+#	define FSYNC_PROBE(fd) IO_PROBE(FSYNC, fd)
+#	define PROBE_BYTES(count) __probe.bytes(count)
 #else
 #	define FUNCTION_PROBE()
 #	define SYSCALL_PROBE()
 #	define FUNCTION_PROBE2(name, suffix)
+#	define SESSION_PROBE(session)
+#	define BUDGET_PROBE(us)
+#	define BUDGET_PROBE2(name, suffix, us)
+#	define PROBE_BUDGET(section, us)
+#	define PROBE_ATTR(name, value)
+#	define PROBE_TAG(name, value)
+#	define IO_PROBE(op, fd)
+#	define READ_PROBE(fd)
+#	define WRITE_PROBE(fd)
+#	define SEND_PROBE(fd)
+#	define RECV_PROBE(fd)
+#	define FSYNC_PROBE(fd)
+#	define PROBE_BYTES(count)
 #endif // FEATURE_IO_WRITE
 
 #endif // __PROFILE_HPP__
@@ -0,0 +1,127 @@
+#ifndef __ROTATE_HPP__
+#define __ROTATE_HPP__
+
+#include "profile.hpp"
+
+#if defined(FEATURE_IO_WRITE) || defined(FEATURE_IO_READ)
+
+#include <string>
+
+namespace profile { namespace io {
+
+	// a file written by a rotator, or a part of one, as the index lists it
+	struct segment
+	{
+		unsigned int sequence;
+		std::string file; // next to the index
+		time::type from;  // ticks
+		time::type to;
+		long long began;  // seconds since the epoch
+		long long ended;
+		call_id first;
+		call_id last;
+	};
+
+}} // profile::io
+
+#endif // FEATURE_IO_WRITE || FEATURE_IO_READ
+
+#if defined(FEATURE_IO_WRITE) && defined(FEATURE_MT_ENABLED)
+
+#include "write.hpp"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace profile { namespace io {
+
+	namespace binary { namespace chunked { class appender; } }
+
+	// For a process, which runs for too long to write everything at exit.
+	// Every interval, or sooner when the session holds max_calls calls,
+	// the calls collected so far are cut off the session and written by
+	// the thread of the rotator into "<basename>.<sequence>.count" (or
+	// .xcount, .ccount), a file of its own with all the functions known
+	// by then. "<basename>.index" lists the segments written so far, with
+	// the ticks and the wall-clock seconds they cover and the ids of their
+	// calls; it is replaced whole, never seen half written, and read back
+	// by read_index(). The last segment is written by the destructor. With
+	// EWriter_CHUNKED, the segments are appended to "<basename>.count"
+	// instead, which stays readable up to the last one written.
+	//
+	// A session keeps only the finished calls, so a call goes to the
+	// segment in which it finished, which may come after the ones of its
+	// children; an attribute goes to the segment in which it was set.
+	class rotator
+	{
+	public:
+		enum { POLL_INTERVAL = 1000 }; // ms, between the checks of max_calls
+
+		typedef io::segment segment;
+
+	private:
+		collecting::session& m_session;
+		std::string m_basename;
+		EWriter m_typeId;
+		unsigned int m_interval;
+		size_t m_max_calls;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		bool m_stop;
+		std::mutex m_write;
+		std::vector<segment> m_segments;
+		std::unique_ptr<binary::chunked::appender> m_appender;
+		time::type m_from;
+		long long m_began;
+		std::thread m_thread;
+
+		void run();
+		void index();
+
+	public:
+		// an interval of zero rotates by the call count only
+		rotator(const char* basename, unsigned int interval_ms, size_t max_calls = 0, EWriter typeId = EWriter_BIN);
+		rotator(collecting::session& session, const char* basename, unsigned int interval_ms, size_t max_calls = 0, EWriter typeId = EWriter_BIN);
+		~rotator();
+
+		rotator(const rotator&) = delete;
+		rotator& operator=(const rotator&) = delete;
+
+		void rotate(); // writes the next segment now
+		std::vector<segment> segments();
+	};
+
+}} // profile::io
+
+#endif // FEATURE_IO_WRITE && FEATURE_MT_ENABLED
+
+#ifdef FEATURE_IO_READ
+
+#include "read.hpp"
+#include <vector>
+
+namespace profile { namespace io {
+
+	struct segment_index
+	{
+		std::vector<segment> m_segments;
+		time::type m_second;
+
+		segment_index(): m_second(1) {}
+	};
+
+	bool read_index(const char* path, segment_index& out);
+
+	// Reads the segments covering any of the ticks from..to, in the order
+	// they were written, into one profile. A file holding more than one
+	// segment, as the one of EWriter_CHUNKED, is read once, whole. False,
+	// when a file fails to read or no segment is in the range.
+	bool read_segments(const char* index, time::type from, time::type to, file_contents& out, unsigned int flags = FAIL_UNKNOWN_FUNCTION);
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
+
+#endif // __ROTATE_HPP__
@@ -0,0 +1,47 @@
+#ifndef __SAMPLER_HPP__
+#define __SAMPLER_HPP__
+
+#ifdef FEATURE_IO_WRITE
+
+#include <cstddef>
+
+namespace profile { namespace sampling {
+
+	enum
+	{
+		MAX_DEPTH = 64,
+		DEFAULT_FREQUENCY = 1000, // Hz of thread CPU time
+		DEFAULT_SAMPLES = 16384   // per thread
+	};
+
+	// Statistical profiler driven by SIGPROF. Only threads which called
+	// attach() are sampled; the signal handler walks the frame pointers
+	// of the thread (on x86-64 and AArch64; the code sampled needs them,
+	// as with -fno-omit-frame-pointer, for whole stacks) and writes the
+	// return addresses into the buffer preallocated by attach(), never
+	// allocating. stop() resolves the stacks with dladdr, outside of the
+	// handler, and folds them into the current session as a calling context
+	// tree of ECallFlag_SAMPLED calls, so both writers and io::read handle
+	// them like any other call. SIGPROF stays handled after stop(), with
+	// the ticks still pending ignored.
+	bool start(unsigned int frequency = DEFAULT_FREQUENCY);
+	void attach(size_t samples = DEFAULT_SAMPLES);
+	void stop();
+
+	// samples lost because a buffer was full, or, with the process-wide
+	// timer used when the threads cannot have one each, because the tick
+	// landed on a thread with no buffer
+	unsigned long long dropped();
+
+	struct session
+	{
+		bool m_started;
+		session(unsigned int frequency = DEFAULT_FREQUENCY): m_started(start(frequency)) {}
+		~session() { if (m_started) stop(); }
+	};
+
+}} // profile::sampling
+
+#endif // FEATURE_IO_WRITE
+
+#endif // __SAMPLER_HPP__
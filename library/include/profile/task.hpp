@@ -0,0 +1,87 @@
+#ifndef __TASK_HPP__
+#define __TASK_HPP__
+
+#include "profile.hpp"
+
+namespace profile { namespace mt {
+
+#ifdef FEATURE_IO_WRITE
+
+	// Taken where a task is handed over to a pool: when, and from which
+	// call. On the worker, a task_probe records the time spent in the
+	// queue as a "<site>/queue" call (ECallFlag_QUEUE_WAIT) and the run
+	// as a call of the probed function (ECallFlag_TASK), both under the
+	// submitting call rather than under the probes open on the worker;
+	// the run keeps the id of its wait in the "queued" attribute.
+	class task
+	{
+		collecting::session* m_session;
+		call_id m_submitter;
+		time::type m_enqueued;
+		const char* m_site;
+
+	public:
+		explicit task(const char* site = "task")
+			: m_session(&collecting::probe::profile())
+			, m_submitter(collecting::probe::anchor(*m_session))
+			, m_enqueued(time::now())
+			, m_site(site)
+		{}
+
+		collecting::session& session() const { return *m_session; }
+		call_id submitter() const { return m_submitter; }
+		time::type enqueued() const { return m_enqueued; }
+		const char* site() const { return m_site; }
+	};
+
+	// Records the wait as the run is about to start, and ties the run to
+	// it once it stopped.
+	struct task_wait: collecting::probe_extra
+	{
+		call_id m_wait;
+
+		explicit task_wait(const task& t)
+		{
+			auto started = time::now();
+			auto waited = started > t.enqueued() ? started - t.enqueued() : 0;
+			m_wait = t.session().call(t.site(), t.site(), "queue", ECallFlag_QUEUE_WAIT, t.submitter(), waited, waited);
+		}
+
+		void stopped(collecting::probe& p)
+		{
+			p.attr("queued", m_wait);
+		}
+	};
+
+	struct task_probe: task_wait, collecting::probe
+	{
+		task_probe(const task& t, const char* name, const char* nice, const char* suffix)
+			: task_wait(t)
+			, probe(t.session(), name, nice, suffix, ECallFlag_TASK, 0, this)
+		{
+			m_call.set_parent(t.submitter());
+			m_detached = true;
+		}
+	};
+
+#else
+
+	class task
+	{
+	public:
+		explicit task(const char* = nullptr) {}
+	};
+
+#endif // FEATURE_IO_WRITE
+
+}} // profile::mt
+
+#ifdef FEATURE_IO_WRITE
+#	define TASK_PROBE(task) profile::mt::task_probe __probe(task, __FUNCDNAME__, __FUNCSIG__, "")
+#	define TASK_PROBE2(task, name, suffix) profile::mt::task_probe name(task, __FUNCDNAME__, __FUNCSIG__, suffix)
+#else
+#	define TASK_PROBE(task)
+#	define TASK_PROBE2(task, name, suffix)
+#endif // FEATURE_IO_WRITE
+
+#endif // __TASK_HPP__
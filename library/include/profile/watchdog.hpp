@@ -0,0 +1,45 @@
+#ifndef __WATCHDOG_HPP__
+#define __WATCHDOG_HPP__
+
+#if defined(FEATURE_IO_WRITE) && defined(FEATURE_MT_ENABLED)
+
+#include "profile.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+namespace profile { namespace mt {
+
+	// Looks at the open probes of every thread each interval. The innermost
+	// probe open for longer than the threshold is recorded as a stall in
+	// the session of that probe, together with the probes around it from
+	// the same session. A call, or any of the calls around it, is reported
+	// only once.
+	class watchdog
+	{
+		time::type m_threshold;
+		unsigned int m_interval;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		bool m_stop;
+		std::set<std::pair<collecting::session*, call_id>> m_reported;
+		std::thread m_thread;
+
+		void run();
+		void scan();
+
+	public:
+		watchdog(unsigned int threshold_ms, unsigned int interval_ms = 100);
+		~watchdog();
+
+		watchdog(const watchdog&) = delete;
+		watchdog& operator=(const watchdog&) = delete;
+	};
+
+}} // profile::mt
+
+#endif // FEATURE_IO_WRITE && FEATURE_MT_ENABLED
+
+#endif // __WATCHDOG_HPP__
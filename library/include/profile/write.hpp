@@ -3,23 +3,57 @@
 
 #ifdef FEATURE_IO_WRITE
 
+#ifdef FEATURE_MT_ENABLED
+#include <functional>
+#include <memory>
+#include <thread>
+#endif // FEATURE_MT_ENABLED
+
+namespace profile { namespace collecting {
+
+	class session;
+
+}} // profile::collecting
+
 namespace profile { namespace io {
 
+	// the overloads without a session write the current one
 	void xml_write(const char* filename);
 	void binary_write(const char* filename);
+	void xml_write(const collecting::session& session, const char* filename);
+	void binary_write(const collecting::session& session, const char* filename);
+
+	// the calls in columns, for columns::open(), see columns.hpp
+	void columns_write(const char* filename);
+	void columns_write(const collecting::session& session, const char* filename);
+
+	// a .count file of checksummed chunks, readable up to where it was
+	// cut short; the rotator appends to one such file, see rotate.hpp
+	void chunked_write(const char* filename);
+	void chunked_write(const collecting::session& session, const char* filename);
 
 	enum EWriter
 	{
 		EWriter_XML,
-		EWriter_BIN
+		EWriter_BIN,
+		EWriter_COLUMNS,
+		EWriter_CHUNKED
 	};
 
 	struct writer
 	{
+		const collecting::session* m_session;
 		const char* m_filename;
 		EWriter    m_typeId;
 		writer(const char* filename, EWriter typeId = EWriter_BIN)
-			: m_filename(filename)
+			: m_session(nullptr)
+			, m_filename(filename)
+			, m_typeId(typeId)
+		{}
+
+		writer(const collecting::session& session, const char* filename, EWriter typeId = EWriter_BIN)
+			: m_session(&session)
+			, m_filename(filename)
 			, m_typeId(typeId)
 		{}
 
@@ -27,12 +61,64 @@ namespace profile { namespace io {
 		{
 			switch (m_typeId)
 			{
-			case EWriter_XML: xml_write(m_filename); break;
-			case EWriter_BIN: binary_write(m_filename); break;
+			case EWriter_XML: m_session ? xml_write(*m_session, m_filename) : xml_write(m_filename); break;
+			case EWriter_BIN: m_session ? binary_write(*m_session, m_filename) : binary_write(m_filename); break;
+			case EWriter_COLUMNS: m_session ? columns_write(*m_session, m_filename) : columns_write(m_filename); break;
+			case EWriter_CHUNKED: m_session ? chunked_write(*m_session, m_filename) : chunked_write(m_filename); break;
 			}
 		}
 	};
 
+#ifdef FEATURE_MT_ENABLED
+	struct write_progress
+	{
+		unsigned long long calls; // written so far
+		unsigned long long total; // in the profile
+		unsigned long long bytes; // in the file so far
+		bool finished;            // the file is closed, this is the last report
+		bool truncated;           // stopped before all of the calls were written
+	};
+
+	// Writes the session on a thread of its own, so that the exit of the
+	// process does not wait for the whole of a large profile. Past the
+	// deadline, counted from the construction, the writer stops within
+	// 64K calls and closes the file with the calls written so far, still
+	// readable: a .count file with the header counting only them, a
+	// .xcount file with its tags closed, a chunked file after its last
+	// chunk of calls. The attributes, the stalls and the other tables
+	// following the calls are left out of such a file, the process stays.
+	// A .ccount file needs all of the calls in each column, so it is
+	// always written whole.
+	//
+	// The session is lent to the writer, see profile_type::lend(), so
+	// the probes of all the threads go on while it writes. The callback
+	// is called on the thread of the writer, after each block of calls
+	// and once more at the end, finished.
+	class async_writer
+	{
+	public:
+		typedef std::function<void (const write_progress&)> callback;
+
+	private:
+		struct impl;
+		std::unique_ptr<impl> m_impl;
+		std::thread m_thread;
+
+	public:
+		// a deadline of zero lets the writer finish
+		async_writer(const char* filename, EWriter typeId = EWriter_BIN, unsigned int deadline_ms = 0, callback progress = callback());
+		async_writer(const collecting::session& session, const char* filename, EWriter typeId = EWriter_BIN, unsigned int deadline_ms = 0, callback progress = callback());
+		~async_writer(); // waits for the file, not much past the deadline
+
+		async_writer(const async_writer&) = delete;
+		async_writer& operator=(const async_writer&) = delete;
+
+		bool wait(unsigned int ms); // true, if the file was closed by then
+		void stop();                // the deadline, now
+		write_progress progress();
+	};
+#endif // FEATURE_MT_ENABLED
+
 }} // profile::io
 
 #endif // FEATURE_IO_WRITE
@@ -11,6 +11,7 @@ TEMPLATE = lib
 CONFIG += staticlib
 
 DEFINES += XML_STATIC FEATURE_IO_READ
+unix:DEFINES += FEATURE_ZLIB
 
 SOURCES += src/profile.cpp \
     src/write.cpp \
@@ -19,15 +20,38 @@ SOURCES += src/profile.cpp \
     src/read.cpp \
     src/read_xml.cpp \
     src/read_binary.cpp \
-    src/reader.cpp
+    src/reader.cpp \
+    src/watchdog.cpp \
+    src/governor.cpp \
+    src/merge_binary.cpp \
+    src/crash_recover.cpp \
+    src/rotate.cpp \
+    src/read_index.cpp \
+    src/columns.cpp \
+    src/codec.cpp
 
 HEADERS += include/profile/profile.hpp \
     include/profile/ticker.hpp \
     include/profile/write.hpp \
     include/profile/read.hpp \
+    include/profile/sampler.hpp \
+    include/profile/mutex.hpp \
+    include/profile/task.hpp \
+    include/profile/counters.hpp \
+    include/profile/watchdog.hpp \
+    include/profile/governor.hpp \
+    include/profile/process.hpp \
+    include/profile/merge.hpp \
+    include/profile/crash.hpp \
+    include/profile/rotate.hpp \
+    include/profile/columns.hpp \
+    include/profile/codec.hpp \
     src/binary.hpp \
     src/reader.hpp \
-    src/expat.hpp
+    src/threads.hpp \
+    src/expat.hpp \
+    src/mapping.hpp \
+    src/job.hpp
 
 unix:!symbian {
     maemo5 {
@@ -39,7 +63,22 @@ unix:!symbian {
 }
 
 win32 {
-SOURCES += src/win32_ticker.cpp
+SOURCES += src/win32_ticker.cpp \
+    src/win32_io.cpp \
+    src/win32_process.cpp \
+    src/win32_counters.cpp \
+    src/win32_crash.cpp \
+    src/win32_mapping.cpp
+}
+
+unix {
+SOURCES += src/posix_ticker.cpp \
+    src/posix_io.cpp \
+    src/posix_sampler.cpp \
+    src/posix_process.cpp \
+    src/posix_counters.cpp \
+    src/posix_crash.cpp \
+    src/posix_mapping.cpp
 }
 
 INCLUDEPATH += \
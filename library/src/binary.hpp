@@ -1,7 +1,15 @@
 #ifndef __BINARY_HPP__
 #define __BINARY_HPP__
 
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "profile/profile.hpp"
+#include "profile/codec.hpp"
+#include "job.hpp"
 
 namespace profile { namespace io { namespace binary {
 
@@ -20,11 +28,47 @@ namespace profile { namespace io { namespace binary {
 	typedef unsigned int u32;
 	typedef unsigned long long u64;
 
+	// the strings of a file, each kept once
+	struct string_table
+	{
+		std::vector<char> data;
+		std::unordered_map<std::string, u32> offsets;
+
+		string_table()
+		{
+			add(std::string()); // "null" string
+		}
+
+		u32 add(const std::string& s)
+		{
+			auto it = offsets.find(s);
+			if (it != offsets.end())
+				return it->second;
+
+			u32 ret = (u32) data.size();
+			data.insert(data.end(), s.begin(), s.end());
+			data.push_back(0);
+			offsets[s] = ret;
+			return ret;
+		}
+
+		// up to the function_offset of the header
+		u32 pad()
+		{
+			data.resize(((data.size() + 3) >> 2) << 2, '\xFF');
+			return (u32) data.size();
+		}
+	};
+
 	namespace file
 	{
 		static const u64 MAGIC = 0x1A454C49464F5250ull;
-		static const u32 VERSION = 0x00010000; // 1.0
+		static const u32 VERSION = 0x00020000; // 2.0, the calls in a CALL block
+		static const u32 VERSION_1 = 0x00010000; // 1.0, the calls as file::calls
+		static const u32 VERSION_WIDE = 0x00020001; // 2.1, as 2.0, with file::counts and the call ids of the blocks 64 bits wide
+		static const u32 VERSION_CHUNKED = 0x00030000; // 3.0, chunks only, see namespace chunked
 
+		// of 2.1, the counts and the offsets are zero, see file::counts
 		struct header
 		{
 			u32 version;
@@ -35,6 +79,15 @@ namespace profile { namespace io { namespace binary {
 			u64 second;
 		};
 
+		// right after the header of 2.1; the one of 2.0 fits in a header
+		struct counts
+		{
+			u64 function_count;
+			u64 call_count;
+			u64 function_offset;
+			u64 call_offset;
+		};
+
 		struct function
 		{
 			u32 id;
@@ -42,6 +95,7 @@ namespace profile { namespace io { namespace binary {
 			u32 suffix;
 		};
 
+		// the calls of 1.0, see call_record for the later ones
 		struct call
 		{
 			u32 id;
@@ -50,6 +104,580 @@ namespace profile { namespace io { namespace binary {
 			u32 flags;
 			u64 duration;
 		};
+
+		// Optional blocks following the calls, up to the end of file.
+		// Readers skip blocks with tags they do not know.
+		struct block
+		{
+			u32 tag;
+			u32 size;
+		};
+
+		enum
+		{
+			BLOCK_ATTRIBUTES = 0x52545441, // "ATTR"
+			BLOCK_IO = 0x54534F49,         // "IOST"
+			BLOCK_STALLS = 0x4C415453,     // "STAL"
+			BLOCK_AGGREGATES = 0x52474741, // "AGGR"
+			BLOCK_VIOLATIONS = 0x4C4F4956, // "VIOL"
+			BLOCK_DOWNGRADES = 0x4E564F47, // "GOVN"
+			BLOCK_PROCESSES = 0x434F5250,  // "PROC"
+			BLOCK_SELF = 0x464C4553,       // "SELF", a u64 for each call, in the order of the calls; 1.0 only
+			BLOCK_CALLS = 0x4C4C4143,      // "CALL", from call_offset on, up to call_count calls of 2.0, see call_encoder
+			BLOCK_PACKED = 0x4B434150      // "PACK", a file::packed, then the payload of its block, packed by the codec
+		};
+
+		// a CALL block, in place of which a PACK block may stand
+		struct packed
+		{
+			u32 codec; // io::ECodec
+			u32 tag;
+			u32 size;  // of the payload before the packing
+			u32 reserved;
+		};
+
+		// in the SELF block, for a call of unknown self time
+		static const u64 NO_SELF = ~0ull;
+
+		struct attribute
+		{
+			u32 call;
+			u32 name;
+			u32 type;
+			u32 tag;
+			u64 value;
+		};
+
+		struct io_stats
+		{
+			u32 function;
+			u32 op;
+			u32 fd_class;
+			u32 reserved;
+			u64 calls;
+			u64 bytes;
+			u64 duration;
+			u64 histogram[collecting::io_stats::BUCKETS];
+		};
+
+		// followed by depth frames
+		struct stall
+		{
+			u32 thread;
+			u32 depth;
+			u64 observed;
+			u64 open;
+		};
+
+		struct frame
+		{
+			u32 call;
+			u32 function;
+		};
+
+		struct aggregate
+		{
+			u32 function;
+			u32 reserved;
+			u64 calls;
+			u64 duration;
+			u64 self;
+			u64 longest;
+			u64 violations;
+			u64 skipped;
+		};
+
+		struct downgrade
+		{
+			u32 function;
+			u32 recording;
+			u32 rate;
+			u32 reserved;
+			u64 at;
+			u64 hits;
+			u64 window;
+		};
+
+		// the calls from first to last, both included, were made by pid
+		struct process
+		{
+			u32 pid;
+			u32 parent;
+			u32 first;
+			u32 last;
+		};
+
+		// followed by depth frames of the stack, then by children frames
+		struct violation
+		{
+			u32 call;
+			u32 function;
+			u32 depth;
+			u32 children;
+			u64 duration;
+			u64 budget;
+		};
+
+		// The records holding call ids, as the blocks of 2.1 lay them out.
+		namespace wide
+		{
+			struct attribute
+			{
+				u64 call;
+				u32 name;
+				u32 type;
+				u32 tag;
+				u32 reserved;
+				u64 value;
+			};
+
+			struct frame
+			{
+				u64 call;
+				u32 function;
+				u32 reserved;
+			};
+
+			struct process
+			{
+				u32 pid;
+				u32 parent;
+				u64 first;
+				u64 last;
+			};
+
+			struct violation
+			{
+				u64 call;
+				u32 function;
+				u32 depth;
+				u32 children;
+				u32 reserved;
+				u64 duration;
+				u64 budget;
+			};
+		}
+
+		// the header, and the counts for 2.1, in place of the header's
+		template <typename Output>
+		void write_header(Output& os, u32 version, const counts& c, u64 second)
+		{
+			header h = { version };
+			if (version != VERSION_WIDE)
+			{
+				h.function_count = (u32) c.function_count;
+				h.call_count = (u32) c.call_count;
+				h.function_offset = (u32) c.function_offset;
+				h.call_offset = (u32) c.call_offset;
+			}
+			h.second = second;
+
+			write(os, h);
+			if (version == VERSION_WIDE)
+				write(os, c);
+		}
+
+		// the counts of 1.0 and 2.0 come from the header
+		inline bool read_header(std::istream& is, header& h, counts& c)
+		{
+			if (!read(is, h))
+				return false;
+
+			if (h.version == VERSION_WIDE)
+				return read(is, c);
+
+			c.function_count = h.function_count;
+			c.call_count = h.call_count;
+			c.function_offset = h.function_offset;
+			c.call_offset = h.call_offset;
+			return true;
+		}
+	}
+
+	// The layouts of the blocks holding call ids. The writers take the
+	// narrow one, of 2.0, whenever the ids and the counts fit in 32 bits,
+	// so that only the profiles past that pay for the wider records.
+	struct narrow_ids
+	{
+		typedef file::attribute attribute;
+		typedef file::frame frame;
+		typedef file::process process;
+		typedef file::violation violation;
+
+		static const u32 VERSION = file::VERSION;
+		static const u64 LARGEST = 0xFFFFFFFFull; // of an id, a count or an offset
+	};
+
+	struct wide_ids
+	{
+		typedef file::wide::attribute attribute;
+		typedef file::wide::frame frame;
+		typedef file::wide::process process;
+		typedef file::wide::violation violation;
+
+		static const u32 VERSION = file::VERSION_WIDE;
+		static const u64 LARGEST = ~0ull;
+	};
+
+	// between the layouts, the ids cut down to 32 bits when narrowing
+	template <typename To, typename From>
+	inline To attribute_as(const From& a)
+	{
+		To out = {};
+		out.call = (decltype(out.call)) a.call;
+		out.name = a.name;
+		out.type = a.type;
+		out.tag = a.tag;
+		out.value = a.value;
+		return out;
+	}
+
+	template <typename To, typename From>
+	inline To frame_as(const From& f)
+	{
+		To out = {};
+		out.call = (decltype(out.call)) f.call;
+		out.function = f.function;
+		return out;
+	}
+
+	template <typename To, typename From>
+	inline To process_as(const From& p)
+	{
+		To out = {};
+		out.pid = p.pid;
+		out.parent = p.parent;
+		out.first = (decltype(out.first)) p.first;
+		out.last = (decltype(out.last)) p.last;
+		return out;
+	}
+
+	template <typename To, typename From>
+	inline To violation_as(const From& v)
+	{
+		To out = {};
+		out.call = (decltype(out.call)) v.call;
+		out.function = v.function;
+		out.depth = v.depth;
+		out.children = v.children;
+		out.duration = v.duration;
+		out.budget = v.budget;
+		return out;
+	}
+
+	// A call, as the records of 2.0 and later hold it, with the ids of
+	// any width.
+	struct call_record
+	{
+		u64 id;
+		u64 parent;
+		u32 function;
+		u32 flags;
+		u64 duration;
+
+		static call_record of(const file::call& c)
+		{
+			call_record out = { c.id, c.parent, c.function, c.flags, c.duration };
+			return out;
+		}
+	};
+
+	// A call of 2.0 is a record of LEB128 varints: the id as a difference
+	// from the previous call, the distance back to the parent (plus one,
+	// zero for none), the function as a difference from the previous call,
+	// the flags, the duration and the time of the children (plus one, zero
+	// for an unknown self time). As the ids are dense and the calls of a
+	// function come together, a call takes 6 to 10 bytes instead of 32.
+	// The calls are split into CALL blocks of up to RANGE calls, encoded
+	// on their own, with the encoder starting afresh in each.
+	struct call_encoder
+	{
+		enum
+		{
+			LONGEST = 60,   // 10 bytes for each value
+			RANGE = 1 << 20 // calls, in a CALL block written by binary_write
+		};
+
+		u64 id;
+		u32 function;
+
+		call_encoder() : id(0), function(0) {}
+
+		static unsigned char* put(unsigned char* out, u64 value)
+		{
+			while (value > 0x7F)
+			{
+				*out++ = (unsigned char) (value | 0x80);
+				value >>= 7;
+			}
+			*out++ = (unsigned char) value;
+			return out;
+		}
+
+		static u64 zigzag(long long value) { return ((u64) value << 1) ^ (u64) (value >> 63); }
+
+		// returns the length of the record, up to LONGEST
+		size_t encode(unsigned char* out, const call_record& c, u64 self)
+		{
+			auto start = out;
+			out = put(out, zigzag((long long) c.id - (long long) id));
+			out = put(out, c.parent ? zigzag((long long) c.id - (long long) c.parent) + 1 : 0);
+			out = put(out, zigzag((long long) c.function - (long long) function));
+			out = put(out, c.flags);
+			out = put(out, c.duration);
+			out = put(out, self == file::NO_SELF ? 0 : c.duration - self + 1);
+
+			id = c.id;
+			function = c.function;
+			return out - start;
+		}
+	};
+
+	struct call_decoder
+	{
+		const unsigned char* pos;
+		const unsigned char* end;
+		u64 id;
+		u32 function;
+
+		call_decoder(const unsigned char* pos, const unsigned char* end) : pos(pos), end(end), id(0), function(0) {}
+
+		bool get(u64& value)
+		{
+			value = 0;
+			for (int shift = 0; pos != end && shift < 64; shift += 7)
+			{
+				unsigned char byte = *pos++;
+				value |= (u64) (byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return true;
+			}
+			return false;
+		}
+
+		static long long unzigzag(u64 value) { return (long long) (value >> 1) ^ -(long long) (value & 1); }
+
+		bool decode(call_record& c, u64& self)
+		{
+			u64 id_, parent, function_, flags, children;
+			if (!get(id_) || !get(parent) || !get(function_) || !get(flags) || !get(c.duration) || !get(children))
+				return false;
+
+			c.id = id = id + unzigzag(id_);
+			c.parent = parent ? c.id - unzigzag(parent - 1) : 0;
+			c.function = function = (u32) (function + unzigzag(function_));
+			c.flags = (u32) flags;
+			self = children ? c.duration - (children - 1) : file::NO_SELF;
+			return true;
+		}
+
+		bool done() const { return pos == end; }
+	};
+
+#ifdef FEATURE_IO_READ
+	// The payload of a PACK block standing for a CALL block, unpacked, if
+	// its codec is known and it is no larger than limit.
+	inline bool unpack_calls(const std::vector<unsigned char>& block, u64 limit, std::vector<unsigned char>& out)
+	{
+		file::packed p;
+		if (block.size() < sizeof(p))
+			return false;
+
+		memcpy(&p, block.data(), sizeof(p));
+		if (p.tag != file::BLOCK_CALLS || p.size > limit)
+			return false;
+
+		auto packer = find_codec(p.codec);
+		if (!packer)
+			return false;
+
+		out.resize(p.size);
+		return packer->unpack(block.data() + sizeof(p), block.size() - sizeof(p), out.data(), out.size());
+	}
+#endif // FEATURE_IO_READ
+
+	// CRC-32 of IEEE 802.3, the one of zlib; crc is the result for the
+	// data before, zero at the start
+	inline u32 crc32(u32 crc, const void* data, size_t size)
+	{
+		static const struct table
+		{
+			u32 entries[256];
+			table()
+			{
+				for (u32 i = 0; i < 256; ++i)
+				{
+					u32 c = i;
+					for (int k = 0; k < 8; ++k)
+						c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+					entries[i] = c;
+				}
+			}
+		} crc_table;
+
+		auto bytes = (const unsigned char*) data;
+		crc = ~crc;
+		while (size--)
+			crc = crc_table.entries[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	// A file of 3.0 is written a chunk at a time, while the process runs:
+	// the header holds only the version and the second, everything else
+	// comes in the chunks following it. Each chunk carries the CRC of its
+	// tag, size and payload, so a reader takes the chunks up to the first
+	// one cut short or damaged, e.g. by a killed process or a full disk,
+	// and skips the ones with tags it does not know.
+	namespace chunked
+	{
+		enum
+		{
+			CHUNK_STRINGS = 0x53525453,   // "STRS", the offset of the first string, then the strings added to the table
+			CHUNK_FUNCTIONS = 0x434E5546, // "FUNC", file::functions
+			CHUNK_CALLS = 0x4C4C4143,     // "CALL", the number of calls, then their records, see call_encoder
+			CHUNK_BLOCKS = 0x534B4C42,    // "BLKS", file::blocks, as the ones following the calls of 2.0
+			CHUNK_WIDE_BLOCKS = 0x574B4C42, // "BLKW", the same, as the ones of 2.1
+			CALLS = 0x10000               // in a CALL chunk, at the most
+		};
+
+		struct chunk
+		{
+			u32 tag;
+			u32 size;
+			u32 crc;
+			u32 reserved;
+		};
+
+		inline u32 crc(const chunk& c, const void* payload)
+		{
+			return crc32(crc32(0, &c, 2 * sizeof(u32)), payload, c.size);
+		}
+
+#ifdef FEATURE_IO_WRITE
+		// Appends the calls of each profile given to one file, along with
+		// the strings and the functions not written before.
+		class appender
+		{
+			struct impl;
+			std::unique_ptr<impl> m_impl;
+
+		public:
+			explicit appender(const std::string& path);
+			~appender();
+
+			appender(const appender&) = delete;
+			appender& operator=(const appender&) = delete;
+
+			// the size of the file so far; stopped by the job, the profile
+			// ends with the last chunk of calls written
+			u64 append(const collecting::profile_type<const char*>& profile, write_job* job = nullptr);
+		};
+#endif // FEATURE_IO_WRITE
+	}
+
+	// The same profile in columns, to be mapped and used in place: after
+	// the magic, the sections, each at an offset aligned to eight bytes,
+	// then their directory, then the footer ending the file. The strings
+	// and the functions are the ones of file::header, the columns hold a
+	// value for each call, in the same order in all of them, and the
+	// blocks are the ones following the calls of the rows.
+	namespace columnar
+	{
+		static const u64 MAGIC = 0x534C4F43464F5250ull; // "PROFCOLS"
+		static const u32 VERSION = 0x00010000; // 1.0
+		static const u32 VERSION_WIDE = 0x00010001; // 1.1, the ids of u64 and the blocks of 2.1
+
+		enum
+		{
+			SECTION_STRINGS = 0x53525453,   // "STRS", the string table
+			SECTION_FUNCTIONS = 0x434E5546, // "FUNC", file::functions
+			SECTION_IDS = 0x53444943,       // "CIDS", u32, u64 of 1.1
+			SECTION_PARENTS = 0x52415043,   // "CPAR", u32, u64 of 1.1, zero for none
+			SECTION_CALLED = 0x4E554643,    // "CFUN", u32, the function ids
+			SECTION_FLAGS = 0x474C4643,     // "CFLG", u32
+			SECTION_DURATIONS = 0x52554443, // "CDUR", u64
+			SECTION_SELF = 0x4C455343,      // "CSEL", u64, file::NO_SELF for unknown
+			SECTION_BLOCKS = 0x534B4C42     // "BLKS", the file::blocks
+		};
+
+		struct section
+		{
+			u32 tag;
+			u32 reserved;
+			u64 offset; // from the start of the file
+			u64 size;
+		};
+
+		// the last bytes of the file, right after section_count sections
+		struct footer
+		{
+			u32 version;
+			u32 section_count;
+			u64 call_count;
+			u64 function_count;
+			u64 second;
+			u64 magic;
+		};
+	}
+
+	// Written by the crash handler, see crash.hpp: the header, then the
+	// blocks the handler got to write before the process was gone.
+	namespace dump
+	{
+		static const u64 MAGIC = 0x504D554448535243ull; // "CRSHDUMP"
+		static const u32 VERSION = 0x00040000; // 4.0, the calls with their self times
+
+		struct header
+		{
+			u32 version;
+			u32 signal;
+			u64 second;
+			u64 at;
+		};
+
+		enum
+		{
+			BLOCK_FUNCTION = 0x434E5546, // "FUNC", a function, then its name and suffix
+			BLOCK_CALLS = 0x534C4143,    // "CALS", the finished calls of the function before
+			BLOCK_OPEN = 0x4E45504F      // "OPEN", a thread, then its open probes, innermost first
+		};
+
+		// a CALS block holds no more calls than this, to stay under 4 GiB;
+		// a function with more has them over several blocks
+		static const u32 CALLS_PER_BLOCK = 1 << 24;
+
+		struct call
+		{
+			u64 id;
+			u64 parent;
+			u32 function;
+			u32 flags;
+			u64 duration;
+			u64 self; // file::NO_SELF for unknown
+		};
+
+		// the lengths of the strings, without the terminating zero
+		struct function
+		{
+			u32 id;
+			u32 name;
+			u32 suffix;
+			u32 reserved;
+		};
+
+		struct thread
+		{
+			u32 index;
+			u32 depth;
+		};
+
+		struct open
+		{
+			u64 call;
+			u32 function;
+			u32 reserved;
+			u64 start;
+		};
 	}
 
 }}} // profile::io::binary
@@ -0,0 +1,134 @@
+#if defined(FEATURE_IO_WRITE) || defined(FEATURE_IO_READ)
+
+#include "profile/codec.hpp"
+
+#include <atomic>
+
+#ifdef FEATURE_MT_ENABLED
+#include <mutex>
+#endif // FEATURE_MT_ENABLED
+
+#ifdef FEATURE_ZLIB
+#include <zlib.h>
+#endif // FEATURE_ZLIB
+
+namespace profile { namespace io {
+
+#ifdef FEATURE_ZLIB
+	class zlib_codec: public codec
+	{
+		int m_level;
+
+	public:
+		explicit zlib_codec(int level): m_level(level) {}
+
+		unsigned int id() const { return ECodec_ZLIB; }
+
+		bool pack(const void* data, size_t size, std::vector<char>& out) const
+		{
+			auto at = out.size();
+			uLongf packed = compressBound((uLong) size);
+			out.resize(at + packed);
+			if (compress2((Bytef*) &out[at], &packed, (const Bytef*) data, (uLong) size, m_level) != Z_OK || packed >= size)
+			{
+				out.resize(at);
+				return false;
+			}
+
+			out.resize(at + packed);
+			return true;
+		}
+
+		bool unpack(const void* data, size_t packed, void* out, size_t size) const
+		{
+			uLongf unpacked = (uLongf) size;
+			return uncompress((Bytef*) out, &unpacked, (const Bytef*) data, (uLong) packed) == Z_OK && unpacked == size;
+		}
+	};
+
+	const codec& zlib_level1()
+	{
+		static zlib_codec level1(Z_BEST_SPEED);
+		return level1;
+	}
+
+	const codec& zlib_level9()
+	{
+		static zlib_codec level9(Z_BEST_COMPRESSION);
+		return level9;
+	}
+#endif // FEATURE_ZLIB
+
+	struct codecs
+	{
+#ifdef FEATURE_MT_ENABLED
+		std::mutex lock;
+#endif // FEATURE_MT_ENABLED
+		std::vector<const codec*> known;
+
+		codecs()
+		{
+#ifdef FEATURE_ZLIB
+			known.push_back(&zlib_level1());
+#endif // FEATURE_ZLIB
+		}
+
+		static codecs& get()
+		{
+			static codecs all;
+			return all;
+		}
+	};
+
+	void register_codec(const codec& c)
+	{
+		auto& all = codecs::get();
+#ifdef FEATURE_MT_ENABLED
+		std::lock_guard<std::mutex> guard(all.lock);
+		(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+		for (auto& known : all.known)
+		{
+			if (known->id() == c.id())
+			{
+				known = &c;
+				return;
+			}
+		}
+		all.known.push_back(&c);
+	}
+
+	const codec* find_codec(unsigned int id)
+	{
+		auto& all = codecs::get();
+#ifdef FEATURE_MT_ENABLED
+		std::lock_guard<std::mutex> guard(all.lock);
+		(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+		for (auto known : all.known)
+		{
+			if (known->id() == id)
+				return known;
+		}
+		return nullptr;
+	}
+
+#ifdef FEATURE_IO_WRITE
+	static std::atomic<const codec*> s_binary_codec(nullptr);
+
+	void binary_codec(const codec* c)
+	{
+		s_binary_codec = c;
+	}
+
+	const codec* binary_codec()
+	{
+		return s_binary_codec;
+	}
+#endif // FEATURE_IO_WRITE
+
+}} // profile::io
+
+#endif // FEATURE_IO_WRITE || FEATURE_IO_READ
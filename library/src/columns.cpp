@@ -0,0 +1,192 @@
+#ifdef FEATURE_IO_READ
+
+#include <profile/columns.hpp>
+#include <profile/read.hpp>
+#include "binary.hpp"
+#include "mapping.hpp"
+#include "reader.hpp"
+#include <cstring>
+#include <sstream>
+
+namespace profile { namespace io {
+
+	struct columns::mapping: mapped_file {};
+
+	columns::columns()
+	{
+		close();
+	}
+
+	columns::~columns()
+	{
+	}
+
+	void columns::close()
+	{
+		m_mapping.reset();
+		m_calls = 0;
+		m_functions = 0;
+		m_second = 1;
+		m_strings = nullptr;
+		m_strings_size = 0;
+		m_function_table = nullptr;
+		m_wide = false;
+		m_ids = nullptr;
+		m_parents = nullptr;
+		m_called = nullptr;
+		m_flags = nullptr;
+		m_durations = nullptr;
+		m_self = nullptr;
+		m_blocks = nullptr;
+		m_blocks_size = 0;
+	}
+
+	bool columns::open(const char* path)
+	{
+		using namespace binary;
+
+		close();
+
+		std::unique_ptr<mapping> map(new mapping);
+		if (!map->open(path))
+			return false;
+
+		auto data = map->data();
+		auto size = map->size();
+
+		binary::columnar::footer foot;
+		u64 magic;
+		if (size < sizeof(magic) + sizeof(foot))
+			return false;
+
+		memcpy(&magic, data, sizeof(magic));
+		memcpy(&foot, data + size - sizeof(foot), sizeof(foot));
+		if (magic != binary::columnar::MAGIC || foot.magic != binary::columnar::MAGIC)
+			return false;
+		if (foot.version != binary::columnar::VERSION && foot.version != binary::columnar::VERSION_WIDE)
+			return false;
+
+		bool wide = foot.version == binary::columnar::VERSION_WIDE;
+		size_t id_size = wide ? sizeof(u64) : sizeof(u32);
+
+		u64 directory = (u64) foot.section_count * sizeof(binary::columnar::section);
+		if (directory > size - sizeof(magic) - sizeof(foot))
+			return false;
+
+		// each section aligned, within the file, and of the size its values need
+		auto sections = (const binary::columnar::section*) (data + size - sizeof(foot) - directory);
+		auto end = size - sizeof(foot) - directory;
+		auto find = [&](u32 tag, u64 count, size_t value, const char*& out, u64& length) -> bool {
+			for (u32 i = 0; i < foot.section_count; ++i)
+			{
+				auto& sec = sections[i];
+				if (sec.tag != tag)
+					continue;
+
+				if (sec.offset % 8 || sec.offset > end || sec.size > end - sec.offset)
+					return false;
+				if (value && sec.size != count * value)
+					return false;
+
+				out = data + sec.offset;
+				length = sec.size;
+				return true;
+			}
+			return false;
+		};
+
+		const char* strings;
+		const char* functions;
+		const char* ids;
+		const char* parents;
+		const char* called;
+		const char* flags;
+		const char* durations;
+		const char* self;
+		const char* blocks;
+		u64 strings_size, length, blocks_size;
+		if (!find(binary::columnar::SECTION_STRINGS, 0, 0, strings, strings_size) ||
+			!find(binary::columnar::SECTION_FUNCTIONS, foot.function_count, sizeof(file::function), functions, length) ||
+			!find(binary::columnar::SECTION_IDS, foot.call_count, id_size, ids, length) ||
+			!find(binary::columnar::SECTION_PARENTS, foot.call_count, id_size, parents, length) ||
+			!find(binary::columnar::SECTION_CALLED, foot.call_count, sizeof(u32), called, length) ||
+			!find(binary::columnar::SECTION_FLAGS, foot.call_count, sizeof(u32), flags, length) ||
+			!find(binary::columnar::SECTION_DURATIONS, foot.call_count, sizeof(u64), durations, length) ||
+			!find(binary::columnar::SECTION_SELF, foot.call_count, sizeof(u64), self, length) ||
+			!find(binary::columnar::SECTION_BLOCKS, 0, 0, blocks, blocks_size))
+			return false;
+
+		// the names point at strings ending within the table
+		auto table = (const file::function*) functions;
+		for (u64 i = 0; i < foot.function_count; ++i)
+		{
+			if (table[i].name >= strings_size || !memchr(strings + table[i].name, 0, strings_size - table[i].name))
+				return false;
+			if (table[i].suffix >= strings_size || !memchr(strings + table[i].suffix, 0, strings_size - table[i].suffix))
+				return false;
+		}
+
+		m_mapping = std::move(map);
+		m_calls = (size_t) foot.call_count;
+		m_functions = (size_t) foot.function_count;
+		m_second = foot.second ? foot.second : 1;
+		m_strings = strings;
+		m_strings_size = (size_t) strings_size;
+		m_function_table = (const unsigned int*) functions;
+		m_wide = wide;
+		m_ids = ids;
+		m_parents = parents;
+		m_called = (const function_id*) called;
+		m_flags = (const unsigned int*) flags;
+		m_durations = (const time::type*) durations;
+		m_self = (const time::type*) self;
+		m_blocks = blocks;
+		m_blocks_size = (size_t) blocks_size;
+		return true;
+	}
+
+	columns::function columns::function_at(size_t index) const
+	{
+		auto& fun = ((const binary::file::function*) m_function_table)[index];
+		function out = { fun.id, m_strings + fun.name, m_strings + fun.suffix };
+		return out;
+	}
+
+	namespace binary
+	{
+		bool read_blocks(std::istream& is, u64 left, bool wide, const std::vector<char>& strings, reader::profile& builder, size_t call_count, std::vector<u64>& self);
+
+		bool read_columns(const columns& file, file_contents& out, int flags)
+		{
+			out.m_second = file.second();
+
+			reader::profile builder(out.m_profile);
+			for (size_t i = 0; i < file.function_count(); ++i)
+			{
+				auto fun = file.function_at(i);
+				if (!builder.function(fun.id, fun.name, fun.suffix, flags))
+					return false;
+			}
+
+			// the attributes name their strings by offset
+			std::vector<char> strings(file.m_strings, file.m_strings + file.m_strings_size);
+			strings.push_back(0);
+
+			std::istringstream blocks(std::string(file.m_blocks, file.m_blocks_size));
+			std::vector<u64> self;
+			if (!read_blocks(blocks, file.m_blocks_size, file.m_wide, strings, builder, file.call_count(), self))
+				return false;
+
+			for (size_t i = 0; i < file.call_count(); ++i)
+			{
+				if (!builder.call(file.id(i), file.parent(i), file.functions()[i], file.flags()[i], file.durations()[i], file.self()[i], flags))
+					return false;
+			}
+
+			return true;
+		}
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
@@ -0,0 +1,179 @@
+#ifdef FEATURE_IO_READ
+
+#include <profile/crash.hpp>
+#include "binary.hpp"
+#include <fstream>
+
+namespace profile { namespace io {
+
+	namespace binary
+	{
+		template <typename Ids>
+		static void write_attributes(std::ostream& os, const std::vector<file::wide::attribute>& attributes)
+		{
+			typedef typename Ids::attribute attribute;
+
+			file::block b = { file::BLOCK_ATTRIBUTES, (u32) (attributes.size() * sizeof(attribute)) };
+			write(os, b);
+			for (auto& a : attributes)
+				write(os, attribute_as<attribute>(a));
+		}
+	}
+
+	bool crash_recover(const char* dump_path, const char* output)
+	{
+		using namespace binary;
+
+		std::ifstream is(dump_path, std::ios::in | std::ios::binary);
+
+		u64 magic = 0;
+		dump::header h;
+		if (!read(is, magic) || magic != dump::MAGIC || !read(is, h) || h.version != dump::VERSION)
+			return false;
+
+		string_table strings;
+		std::vector<file::function> functions;
+		std::vector<call_record> calls;
+		std::vector<u64> self;
+		std::vector<std::vector<dump::open>> threads;
+
+		// up to the end, or to where the handler stopped
+		file::block b;
+		bool complete = true;
+		while (complete && read(is, b))
+		{
+			switch (b.tag)
+			{
+			case dump::BLOCK_FUNCTION:
+			{
+				dump::function fun;
+				if (b.size < sizeof(fun) || !read(is, fun) || b.size != sizeof(fun) + (u64) fun.name + fun.suffix)
+				{
+					complete = false;
+					break;
+				}
+
+				std::string name(fun.name, '\0');
+				std::string suffix(fun.suffix, '\0');
+				if ((fun.name && !is.read(&name[0], fun.name)) || (fun.suffix && !is.read(&suffix[0], fun.suffix)))
+				{
+					complete = false;
+					break;
+				}
+
+				file::function out = { fun.id, strings.add(name), strings.add(suffix) };
+				functions.push_back(out);
+				break;
+			}
+
+			case dump::BLOCK_CALLS:
+				complete = !(b.size % sizeof(dump::call));
+				for (u32 i = 0; complete && i < b.size / sizeof(dump::call); ++i)
+				{
+					dump::call c;
+					complete = read(is, c);
+					if (complete)
+					{
+						call_record out = { c.id, c.parent, c.function, c.flags, c.duration };
+						calls.push_back(out);
+						self.push_back(c.self);
+					}
+				}
+				break;
+
+			case dump::BLOCK_OPEN:
+			{
+				dump::thread thread;
+				complete = b.size >= sizeof(thread) && read(is, thread);
+
+				std::vector<dump::open> frames;
+				for (u32 i = 0; complete && i < thread.depth; ++i)
+				{
+					dump::open open;
+					complete = read(is, open);
+					if (complete)
+						frames.push_back(open);
+				}
+
+				if (complete)
+					threads.push_back(frames);
+				break;
+			}
+
+			default:
+				complete = is.ignore(b.size).gcount() == b.size;
+			}
+		}
+
+		// the open calls end with the crash; their probes keep them until
+		// they finish, so they are only in the OPEN blocks
+		std::vector<file::wide::attribute> attributes;
+		auto crashed = strings.add("crashed");
+		for (auto& frames : threads)
+		{
+			u64 parent = 0;
+			for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+			{
+				auto duration = h.at > it->start ? h.at - it->start : 0;
+				call_record c = { it->call, parent, it->function, 0, duration };
+				calls.push_back(c);
+				self.push_back(file::NO_SELF);
+
+				file::wide::attribute a = { it->call, crashed, (u32) EAttribute_U64, 0, 0, h.signal };
+				attributes.push_back(a);
+				parent = it->call;
+			}
+		}
+
+		file::counts counts;
+		counts.function_count = functions.size();
+		counts.call_count = calls.size();
+		counts.function_offset = strings.pad();
+		counts.call_offset = counts.function_offset + counts.function_count * sizeof(file::function);
+
+		bool wide = counts.call_count > narrow_ids::LARGEST || counts.call_offset > narrow_ids::LARGEST;
+		for (auto& c : calls)
+			wide = wide || c.id > narrow_ids::LARGEST;
+
+		std::ofstream os(output, std::ios::out | std::ios::binary);
+		write(os, file::MAGIC);
+		file::write_header(os, wide ? file::VERSION_WIDE : file::VERSION, counts, h.second);
+		os.write(&strings.data[0], strings.data.size());
+		for (auto& f : functions)
+			write(os, f);
+
+		// in blocks of up to RANGE calls, as binary_write splits them
+		std::vector<unsigned char> records;
+		size_t from = 0;
+		do
+		{
+			auto count = calls.size() - from;
+			if (count > call_encoder::RANGE)
+				count = call_encoder::RANGE;
+
+			records.resize(count * call_encoder::LONGEST);
+			call_encoder encoder;
+			size_t size = 0;
+			for (size_t i = from; i < from + count; ++i)
+				size += encoder.encode(&records[size], calls[i], self[i]);
+
+			file::block cb = { file::BLOCK_CALLS, (u32) size };
+			write(os, cb);
+			os.write((const char*) records.data(), size);
+			from += count;
+		} while (from < calls.size());
+
+		if (!attributes.empty())
+		{
+			if (wide)
+				write_attributes<wide_ids>(os, attributes);
+			else
+				write_attributes<narrow_ids>(os, attributes);
+		}
+
+		return !!os;
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
@@ -0,0 +1,106 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/governor.hpp"
+
+#include <atomic>
+#include <deque>
+
+namespace profile { namespace governor {
+
+	enum { CALIBRATION_ROUNDS = 10000 };
+
+	static std::atomic<time::type> s_next(0);
+	static time::type s_start = 0;
+	static std::atomic<time::type> s_last(0); // swapped by the tick() opening a window
+	static time::type s_window = 0;
+	static time::type s_costs[3] = {};
+	static double s_limit = 0;
+	static std::atomic<collecting::session*> s_session(nullptr); // set by start() last, after the rest
+
+	// Replays the work of a probe: the clock reads of the call and of
+	// tick(), the lock taken once for a kept call, twice for a counted
+	// one (the second time to update the aggregate), and storing the call.
+	static time::type calibrate(EAdmit admit)
+	{
+		std::deque<collecting::call> calls;
+#ifdef FEATURE_MT_ENABLED
+		mt::spin_lock barrier;
+#endif // FEATURE_MT_ENABLED
+		time::type sink = 0;
+
+		auto start = time::now();
+		for (unsigned int i = 0; i < CALIBRATION_ROUNDS; ++i)
+		{
+			auto begin = admit == EAdmit_SKIP ? 0 : time::now();
+			for (int lock = admit == EAdmit_COUNT ? 2 : 1; lock > 0; --lock)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(barrier);
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				if (admit == EAdmit_KEEP)
+					calls.emplace_back(i + 1, 0);
+			}
+			if (admit != EAdmit_SKIP)
+				sink += time::now() - begin;
+			sink += time::now();
+		}
+		auto cost = (time::now() - start) / CALIBRATION_ROUNDS;
+
+		(void)(sink);
+		return cost ? cost : 1;
+	}
+
+	bool start(double percent, unsigned int window_ms)
+	{
+		return start(collecting::probe::profile(), percent, window_ms);
+	}
+
+	bool start(collecting::session& profile, double percent, unsigned int window_ms)
+	{
+		if (s_session.load() || percent <= 0 || !window_ms)
+			return false;
+
+		for (auto admit : { EAdmit_KEEP, EAdmit_COUNT, EAdmit_SKIP })
+			s_costs[admit] = calibrate(admit);
+
+		s_limit = percent / 100;
+		s_window = time::second() * window_ms / 1000;
+		s_start = time::now();
+		s_last.store(s_start);
+		s_next.store(s_start + s_window);
+
+		profile.govern(true);
+		s_session.store(&profile);
+		return true;
+	}
+
+	void stop()
+	{
+		auto governed = s_session.exchange(nullptr);
+		if (governed)
+			governed->govern(false);
+	}
+
+	time::type cost(EAdmit admit) { return s_costs[admit]; }
+
+	void tick()
+	{
+		auto governed = s_session.load();
+		if (!governed)
+			return;
+
+		auto now = time::now();
+		auto next = s_next.load(std::memory_order_relaxed);
+		if (now < next || !s_next.compare_exchange_strong(next, now + s_window))
+			return;
+
+		auto window = now - s_last.exchange(now);
+		governed->throttle(s_limit, now - s_start, window, s_costs, SAMPLING_RATE);
+	}
+
+}} // profile::governor
+
+#endif // FEATURE_IO_WRITE
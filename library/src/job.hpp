@@ -0,0 +1,26 @@
+#ifndef __JOB_HPP__
+#define __JOB_HPP__
+
+#ifdef FEATURE_IO_WRITE
+
+namespace profile { namespace io {
+
+	// What async_writer hands the writers: they ask it every CALLS calls
+	// whether to stop there, from any of their threads, and tell it how
+	// far they got, from one. A writer stopped early closes its file with
+	// the calls written so far.
+	class write_job
+	{
+	public:
+		enum { CALLS = 0x10000 }; // between the checks
+
+		virtual ~write_job() {}
+		virtual bool expired() = 0;
+		virtual void written(unsigned long long calls, unsigned long long total, unsigned long long bytes) = 0;
+	};
+
+}} // profile::io
+
+#endif // FEATURE_IO_WRITE
+
+#endif // __JOB_HPP__
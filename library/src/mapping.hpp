@@ -0,0 +1,35 @@
+#ifndef __MAPPING_HPP__
+#define __MAPPING_HPP__
+
+#ifdef FEATURE_IO_READ
+
+#include <cstddef>
+
+namespace profile { namespace io {
+
+	// a file mapped read-only, whole; see posix_mapping.cpp and win32_mapping.cpp
+	class mapped_file
+	{
+		const char* m_data;
+		size_t m_size;
+		void* m_handle;
+
+	public:
+		mapped_file(): m_data(nullptr), m_size(0), m_handle(nullptr) {}
+		~mapped_file() { close(); }
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		bool open(const char* path);
+		void close();
+
+		const char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+	};
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
+
+#endif // __MAPPING_HPP__
@@ -0,0 +1,618 @@
+#ifdef FEATURE_IO_READ
+
+#include <profile/merge.hpp>
+#include "binary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+namespace profile { namespace io { namespace binary {
+
+	struct merge_input
+	{
+		std::ifstream is;
+		file::header h;
+		file::counts counts;
+		std::unordered_map<u32, u32> strings;   // offsets, from the input to the output
+		std::unordered_map<u32, u32> functions; // ids, from the input to the output
+		std::streampos calls;
+		u64 base;
+		u64 first;
+		u64 last;
+		u64 largest; // of the ids moved so far
+		bool has_process;
+		std::vector<u64> self; // of the calls of 1.0, read ahead from their SELF block
+		std::vector<std::pair<u64, u64>> processes; // the first and the last id of each, read ahead
+
+		merge_input(const std::string& path)
+			: is(path, std::ios::in | std::ios::binary)
+			, base(0)
+			, first(0)
+			, last(0)
+			, largest(0)
+			, has_process(false)
+		{
+		}
+
+		// back to the first call, for another pass
+		bool rewind()
+		{
+			base = first = last = largest = 0;
+			has_process = false;
+			is.clear();
+			return !!is.seekg(calls);
+		}
+
+		u32 string(u32 offset) const
+		{
+			auto it = strings.find(offset);
+			return it == strings.end() ? 0 : it->second;
+		}
+
+		u32 function(u32 id) const
+		{
+			auto it = functions.find(id);
+			return it == functions.end() ? 0 : it->second;
+		}
+
+		u64 call(u64 id)
+		{
+			if (!id)
+				return 0;
+
+			id += base;
+			if (largest < id)
+				largest = id;
+			return id;
+		}
+
+		file::wide::frame rebase(const file::wide::frame& f)
+		{
+			file::wide::frame out = { call(f.call), function(f.function) };
+			return out;
+		}
+	};
+
+	template <typename Process>
+	static bool read_processes(merge_input& in, const file::block& b)
+	{
+		if (b.size % sizeof(Process))
+			return false;
+
+		for (u32 i = 0; i < b.size / sizeof(Process); ++i)
+		{
+			Process p;
+			if (!read(in.is, p))
+				return false;
+			in.processes.push_back(std::make_pair((u64) p.first, (u64) p.last));
+		}
+		return true;
+	}
+
+	// the ranges of ids of the processes, from the blocks after the calls
+	static bool processes(merge_input& in)
+	{
+		file::block b;
+		while (read(in.is, b))
+		{
+			if (b.tag != file::BLOCK_PROCESSES)
+			{
+				if (!in.is.seekg(b.size, std::ios::cur))
+					return false;
+				continue;
+			}
+
+			bool ok = in.h.version == file::VERSION_WIDE ? read_processes<file::wide::process>(in, b) : read_processes<file::process>(in, b);
+			if (!ok)
+				return false;
+		}
+		return true;
+	}
+
+	// the header, the strings and the functions; leaves the stream at the first call
+	static bool open(merge_input& in, string_table& strings, std::unordered_map<std::string, u32>& ids, std::vector<file::function>& functions)
+	{
+		u64 magic = 0;
+		if (!read(in.is, magic) || magic != file::MAGIC || !file::read_header(in.is, in.h, in.counts))
+			return false;
+
+		auto& counts = in.counts;
+		if (in.h.version != file::VERSION && in.h.version != file::VERSION_WIDE && in.h.version != file::VERSION_1)
+			return false;
+
+		if (counts.function_offset % 4 || counts.function_offset > narrow_ids::LARGEST || counts.call_offset < counts.function_offset)
+			return false;
+
+		if ((counts.call_offset - counts.function_offset) / sizeof(file::function) != counts.function_count)
+			return false;
+
+		std::vector<char> local((size_t) counts.function_offset + 1);
+		if (in.is.read(&local[0], counts.function_offset).gcount() != (std::streamsize) counts.function_offset)
+			return false;
+		local[counts.function_offset] = 0;
+
+		// the padding after the last string is not a string
+		for (u32 offset = 0; offset < counts.function_offset && local[offset] != '\xFF'; )
+		{
+			auto length = strlen(&local[offset]);
+			in.strings[offset] = strings.add(std::string(&local[offset], length));
+			offset += length + 1;
+		}
+
+		for (u64 i = 0; i < counts.function_count; ++i)
+		{
+			file::function fun;
+			if (!read(in.is, fun))
+				return false;
+
+			auto name = in.string(fun.name);
+			auto suffix = in.string(fun.suffix);
+
+			std::string key(&strings.data[name]);
+			key.push_back(0);
+			key.append(&strings.data[suffix]);
+
+			auto it = ids.find(key);
+			if (it == ids.end())
+			{
+				file::function out = { (u32) functions.size() + 1, name, suffix };
+				functions.push_back(out);
+				it = ids.insert(std::make_pair(key, out.id)).first;
+			}
+
+			in.functions[fun.id] = it->second;
+		}
+
+		in.calls = in.is.tellg();
+		if (in.h.version != file::VERSION_1)
+			return processes(in) && in.rewind();
+
+		// the self times of 1.0 follow the calls, but go into the records
+		if (!in.is.ignore((std::streamsize) counts.call_count * sizeof(file::call)))
+			return false;
+
+		file::block b;
+		while (read(in.is, b))
+		{
+			if (b.tag != file::BLOCK_SELF)
+			{
+				if (in.is.ignore(b.size).gcount() != b.size)
+					return false;
+				continue;
+			}
+
+			if (b.size != counts.call_count * sizeof(u64))
+				return false;
+
+			in.self.resize((size_t) counts.call_count);
+			if (!in.self.empty() && in.is.read((char*) &in.self[0], b.size).gcount() != b.size)
+				return false;
+			break;
+		}
+
+		return in.rewind();
+	}
+
+	// the calls of either version, the ones of 2.0 read a buffer at a time
+	class call_reader
+	{
+		enum { BUFFER = 64 * 1024 };
+
+		merge_input& m_in;
+		std::vector<unsigned char> m_buffer;
+		u32 m_left; // of the current CALL block, in the file
+		call_decoder m_decoder;
+		u64 m_index;
+
+	public:
+		call_reader(merge_input& in)
+			: m_in(in)
+			, m_left(0)
+			, m_decoder(nullptr, nullptr)
+			, m_index(0)
+		{
+		}
+
+		bool next(call_record& c, u64& self)
+		{
+			if (m_in.h.version == file::VERSION_1)
+			{
+				self = m_index < m_in.self.size() ? m_in.self[(size_t) m_index] : file::NO_SELF;
+				++m_index;
+
+				file::call old;
+				if (!read(m_in.is, old))
+					return false;
+				c = call_record::of(old);
+				return true;
+			}
+
+			// the next block, once this one is done, with the decoder afresh;
+			// a packed one is unpacked whole
+			if (!m_left && m_decoder.done())
+			{
+				file::block b;
+				if (!read(m_in.is, b))
+					return false;
+
+				m_decoder = call_decoder(nullptr, nullptr);
+				if (b.tag == file::BLOCK_PACKED)
+				{
+					u64 limit = (m_in.counts.call_count - m_index) * call_encoder::LONGEST;
+					std::vector<unsigned char> packed(b.size);
+					if (b.size > limit + sizeof(file::packed) || (b.size && m_in.is.read((char*) &packed[0], b.size).gcount() != b.size))
+						return false;
+					if (!unpack_calls(packed, limit, m_buffer))
+						return false;
+
+					m_decoder.pos = m_buffer.data();
+					m_decoder.end = m_buffer.data() + m_buffer.size();
+				}
+				else if (b.tag == file::BLOCK_CALLS)
+					m_left = b.size;
+				else
+					return false;
+			}
+
+			// a record may not be cut by the end of the buffer
+			size_t rest = m_decoder.end - m_decoder.pos;
+			if (rest < call_encoder::LONGEST && m_left)
+			{
+				std::vector<unsigned char> next(m_decoder.pos, m_decoder.end);
+				u32 chunk = m_left < BUFFER ? m_left : BUFFER;
+				next.resize(rest + chunk);
+				if (m_in.is.read((char*) &next[rest], chunk).gcount() != chunk)
+					return false;
+				m_left -= chunk;
+				m_buffer.swap(next);
+				m_decoder.pos = m_buffer.data();
+				m_decoder.end = m_buffer.data() + m_buffer.size();
+			}
+
+			++m_index;
+			return m_decoder.decode(c, self);
+		}
+
+		// all of the block was read
+		bool done() const { return m_in.h.version == file::VERSION_1 || (!m_left && m_decoder.done()); }
+	};
+
+	// records of the same size each, in and out; convert returns the one
+	// to write for the one read, rebased
+	template <typename From, typename F>
+	static bool copy_records(merge_input& in, std::ostream& os, const file::block& b, F convert)
+	{
+		typedef decltype(convert(std::declval<const From&>())) To;
+
+		if (b.size % sizeof(From))
+			return false;
+
+		u32 count = b.size / sizeof(From);
+		file::block out = { b.tag, (u32) (count * sizeof(To)) };
+		write(os, out);
+		for (u32 i = 0; i < count; ++i)
+		{
+			From t;
+			if (!read(in.is, t))
+				return false;
+			write(os, convert(t));
+		}
+		return true;
+	}
+
+	// a record followed by frames, as many as frames() tells; the block
+	// is put together before it is written, as the layouts of the input
+	// and of the output may differ in size
+	template <typename In, typename Out, typename From, typename F, typename N>
+	static bool copy_framed(merge_input& in, std::ostream& os, file::block b, F convert, N frames)
+	{
+		typedef typename In::frame frame;
+
+		std::ostringstream body;
+		while (b.size)
+		{
+			From t;
+			if (b.size < sizeof(t) || !read(in.is, t))
+				return false;
+			b.size -= sizeof(t);
+
+			u64 count = frames(t);
+			if (b.size / sizeof(frame) < count)
+				return false;
+			b.size -= (u32) (count * sizeof(frame));
+
+			write(body, convert(t));
+
+			for (u64 i = 0; i < count; ++i)
+			{
+				frame f;
+				if (!read(in.is, f))
+					return false;
+				write(body, frame_as<typename Out::frame>(in.rebase(frame_as<file::wide::frame>(f))));
+			}
+		}
+
+		auto data = body.str();
+		file::block out = { b.tag, (u32) data.size() };
+		write(os, out);
+		os.write(data.data(), data.size());
+		return true;
+	}
+
+	// from the layout of In to the one of Out
+	template <typename In, typename Out>
+	static bool copy_blocks(merge_input& in, std::ostream& os)
+	{
+		typedef typename In::attribute attribute;
+		typedef typename In::process process;
+		typedef typename In::violation violation;
+
+		file::block b;
+		while (read(in.is, b))
+		{
+			bool ok = true;
+			switch (b.tag)
+			{
+			case file::BLOCK_ATTRIBUTES:
+				ok = copy_records<attribute>(in, os, b, [&](const attribute& a) -> typename Out::attribute {
+					auto out = attribute_as<typename Out::attribute>(a);
+					out.call = (decltype(out.call)) in.call(a.call);
+					out.name = in.string(a.name);
+					if (a.type == EAttribute_TAG)
+						out.tag = in.string(a.tag);
+					return out;
+				});
+				break;
+
+			case file::BLOCK_IO:
+				ok = copy_records<file::io_stats>(in, os, b, [&](file::io_stats io) -> file::io_stats {
+					io.function = in.function(io.function);
+					return io;
+				});
+				break;
+
+			case file::BLOCK_AGGREGATES:
+				ok = copy_records<file::aggregate>(in, os, b, [&](file::aggregate a) -> file::aggregate {
+					a.function = in.function(a.function);
+					return a;
+				});
+				break;
+
+			case file::BLOCK_DOWNGRADES:
+				ok = copy_records<file::downgrade>(in, os, b, [&](file::downgrade d) -> file::downgrade {
+					d.function = in.function(d.function);
+					return d;
+				});
+				break;
+
+			case file::BLOCK_PROCESSES:
+				in.has_process = true;
+				ok = copy_records<process>(in, os, b, [&](const process& p) -> typename Out::process {
+					auto out = process_as<typename Out::process>(p);
+					out.first = (decltype(out.first)) in.call(p.first);
+					out.last = (decltype(out.last)) in.call(p.last);
+					return out;
+				});
+				break;
+
+			case file::BLOCK_STALLS:
+				ok = copy_framed<In, Out, file::stall>(in, os, b,
+					[](const file::stall& st) -> file::stall { return st; },
+					[](const file::stall& st) -> u64 { return st.depth; });
+				break;
+
+			case file::BLOCK_VIOLATIONS:
+				ok = copy_framed<In, Out, violation>(in, os, b,
+					[&](const violation& v) -> typename Out::violation {
+						auto out = violation_as<typename Out::violation>(v);
+						out.call = (decltype(out.call)) in.call(v.call);
+						out.function = in.function(v.function);
+						return out;
+					},
+					[](const violation& v) -> u64 { return (u64) v.depth + v.children; });
+				break;
+
+			default:
+				// nothing known to move the ids of
+				if (in.is.ignore(b.size).gcount() != b.size)
+					return false;
+			}
+
+			if (!ok)
+				return false;
+		}
+
+		return true;
+	}
+
+	enum EMerge
+	{
+		EMerge_DONE,
+		EMerge_FAILED,
+		EMerge_WIDE // the ids moved past the ones Ids can hold
+	};
+
+	// one pass over the inputs, from their first calls on
+	template <typename Ids>
+	static EMerge merge(const char* output, std::vector<std::unique_ptr<merge_input>>& files, const string_table& strings, const std::vector<file::function>& functions, const file::counts& counts, u64 second, bool rebase)
+	{
+		std::ofstream os(output, std::ios::out | std::ios::binary);
+		write(os, file::MAGIC);
+		file::write_header(os, Ids::VERSION, counts, second);
+		os.write(&strings.data[0], strings.data.size());
+		for (auto& f : functions)
+			write(os, f);
+
+		// the size of a block is known after its last call
+		auto at = os.tellp();
+		file::block calls = { file::BLOCK_CALLS, 0 };
+		write(os, calls);
+
+		auto close = [&] {
+			calls.size = (u32) (os.tellp() - at - (std::streamoff) sizeof(calls));
+			os.seekp(at);
+			write(os, calls);
+			os.seekp(0, std::ios::end);
+		};
+
+		call_encoder encoder;
+		unsigned char record[call_encoder::LONGEST];
+		u32 in_block = 0;
+		u64 base = 0;
+		for (auto& in : files)
+		{
+			in->base = base;
+
+			call_reader reader(*in);
+			u64 last = 0;
+			for (u64 i = 0; i < in->counts.call_count; ++i)
+			{
+				call_record c;
+				u64 self;
+				if (!reader.next(c, self))
+					return EMerge_FAILED;
+
+				if (last < c.id)
+					last = c.id;
+
+				c.id = in->call(c.id);
+				c.parent = in->call(c.parent);
+				c.function = in->function(c.function);
+				if (!c.function)
+					return EMerge_FAILED;
+				if (in->largest > Ids::LARGEST)
+					return EMerge_WIDE;
+
+				if (!in->first || in->first > c.id)
+					in->first = c.id;
+
+				if (in_block == call_encoder::RANGE)
+				{
+					close();
+					at = os.tellp();
+					write(os, calls);
+					encoder = call_encoder();
+					in_block = 0;
+				}
+
+				os.write((const char*) record, encoder.encode(record, c, self));
+				++in_block;
+			}
+
+			if (!reader.done())
+				return EMerge_FAILED;
+
+			in->last = in->call(last);
+			if (rebase)
+				base += last;
+		}
+
+		close();
+
+		for (auto& in : files)
+		{
+			bool ok = in->h.version == file::VERSION_WIDE ? copy_blocks<wide_ids, Ids>(*in, os) : copy_blocks<narrow_ids, Ids>(*in, os);
+			if (!ok)
+				return EMerge_FAILED;
+			if (in->largest > Ids::LARGEST)
+				return EMerge_WIDE;
+		}
+
+		// files from before the processes were kept
+		std::vector<typename Ids::process> processes;
+		for (auto& in : files)
+		{
+			if (in->has_process)
+				continue;
+
+			file::wide::process p = { 0, 0, in->first, in->last };
+			processes.push_back(process_as<typename Ids::process>(p));
+		}
+
+		if (!processes.empty())
+		{
+			file::block b = { file::BLOCK_PROCESSES, (u32) (processes.size() * sizeof(typename Ids::process)) };
+			write(os, b);
+			for (auto& p : processes)
+				write(os, p);
+		}
+
+		return os ? EMerge_DONE : EMerge_FAILED;
+	}
+
+}}} // profile::io::binary
+
+namespace profile { namespace io {
+
+	bool binary_merge(const char* output, const std::vector<std::string>& inputs)
+	{
+		using namespace binary;
+
+		binary::string_table strings;
+		std::unordered_map<std::string, u32> ids;
+		std::vector<file::function> functions;
+		std::vector<std::unique_ptr<merge_input>> files;
+
+		file::counts counts = {};
+		u64 second = 0;
+		bool wide = false;
+		for (auto& path : inputs)
+		{
+			files.emplace_back(new merge_input(path));
+			auto& in = *files.back();
+			if (!open(in, strings, ids, functions))
+				return false;
+
+			if (files.size() == 1)
+				second = in.h.second;
+			else if (in.h.second != second)
+				return false;
+
+			counts.call_count += in.counts.call_count;
+			wide = wide || in.h.version == file::VERSION_WIDE;
+		}
+
+		// The processes of one tree give ids of their own, see
+		// collecting::session, and a child refers to the open calls of
+		// its parent by their ids; those are kept, unless the ranges of
+		// the processes overlap, e.g. for files of separate runs.
+		std::vector<std::pair<u64, u64>> ranges;
+		bool rebase = false;
+		for (auto& in : files)
+		{
+			rebase = rebase || in->processes.empty();
+			ranges.insert(ranges.end(), in->processes.begin(), in->processes.end());
+		}
+		std::sort(ranges.begin(), ranges.end());
+		for (size_t i = 1; !rebase && i < ranges.size(); ++i)
+			rebase = ranges[i].first <= ranges[i - 1].second;
+		if (!rebase && !ranges.empty())
+			wide = wide || ranges.back().second > narrow_ids::LARGEST;
+
+		counts.function_count = functions.size();
+		counts.function_offset = strings.pad();
+		counts.call_offset = counts.function_offset + counts.function_count * sizeof(file::function);
+		wide = wide || counts.call_count > narrow_ids::LARGEST || counts.call_offset > narrow_ids::LARGEST;
+
+		// whether the ids still fit in 32 bits is known only once they
+		// are moved; if they do not, everything once more, into 2.1
+		auto merged = wide ? EMerge_WIDE : merge<narrow_ids>(output, files, strings, functions, counts, second, rebase);
+		if (merged == EMerge_WIDE)
+		{
+			for (auto& in : files)
+			{
+				if (!in->rewind())
+					return false;
+			}
+			merged = merge<wide_ids>(output, files, strings, functions, counts, second, rebase);
+		}
+
+		return merged == EMerge_DONE;
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
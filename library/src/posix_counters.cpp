@@ -0,0 +1,258 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/counters.hpp"
+
+#include <atomic>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace profile { namespace counters {
+
+	struct event
+	{
+		unsigned int type;
+		unsigned long long config;
+		const char* name;
+	};
+
+	static const event s_events[][MAX_COUNTERS] = {
+		{},
+		{
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses" },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" }
+		},
+		{
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task-clock" },
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page-faults" },
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches" },
+			{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, "cpu-migrations" }
+		}
+	};
+
+	static std::atomic<int> s_mode(ECounters_OFF);
+	static std::atomic<unsigned int> s_generation(0); // the threads reopen their counters, when it changes
+	static unsigned int s_mask = 0;                   // of the counters start() could open
+
+#if defined(__x86_64__) || defined(__i386__)
+	static unsigned long long rdpmc(unsigned int counter)
+	{
+		unsigned int lo, hi;
+		__asm__ volatile("rdpmc" : "=a" (lo), "=d" (hi) : "c" (counter));
+		return ((unsigned long long) hi << 32) | lo;
+	}
+
+	// The page is updated by the kernel whenever the thread is scheduled;
+	// its lock is a sequence counter, read before and after the counter.
+	static bool read_user(const volatile perf_event_mmap_page* page, unsigned long long& value)
+	{
+		unsigned int seq;
+		do
+		{
+			seq = page->lock;
+			std::atomic_signal_fence(std::memory_order_acquire);
+
+			unsigned int index = page->index;
+			if (!page->cap_user_rdpmc || !index)
+				return false;
+
+			unsigned int shift = 64 - page->pmc_width;
+			long long pmc = (long long) (rdpmc(index - 1) << shift) >> shift;
+			value = page->offset + pmc;
+
+			std::atomic_signal_fence(std::memory_order_acquire);
+		} while (page->lock != seq);
+
+		return true;
+	}
+#else
+	static bool read_user(const volatile perf_event_mmap_page*, unsigned long long&)
+	{
+		return false;
+	}
+#endif
+
+	// The counters of one thread, in one group, so a single read() gets
+	// all of them when they cannot be read in user space.
+	class thread_counters
+	{
+		int m_fd[MAX_COUNTERS];
+		perf_event_mmap_page* m_page[MAX_COUNTERS];
+		unsigned int m_order[MAX_COUNTERS]; // of the values in a group read
+		unsigned int m_opened;
+		unsigned int m_mask;
+		bool m_user;
+		unsigned int m_generation;
+
+		int leader() const { return m_opened ? m_fd[m_order[0]] : -1; }
+
+	public:
+		thread_counters()
+			: m_opened(0)
+			, m_mask(0)
+			, m_user(false)
+			, m_generation(0)
+		{
+			for (auto& fd : m_fd)
+				fd = -1;
+			for (auto& page : m_page)
+				page = nullptr;
+		}
+
+		~thread_counters() { close(); }
+
+		thread_counters(const thread_counters&) = delete;
+		thread_counters& operator=(const thread_counters&) = delete;
+
+		unsigned int generation() const { return m_generation; }
+
+		void close()
+		{
+			auto size = (size_t) sysconf(_SC_PAGESIZE);
+			for (unsigned int i = 0; i < MAX_COUNTERS; ++i)
+			{
+				if (m_page[i])
+					munmap(m_page[i], size);
+				if (m_fd[i] >= 0)
+					::close(m_fd[i]);
+				m_page[i] = nullptr;
+				m_fd[i] = -1;
+			}
+			m_opened = 0;
+			m_mask = 0;
+			m_user = false;
+		}
+
+		// a mask of the counters opened
+		unsigned int open(ECounters mode, unsigned int generation)
+		{
+			close();
+			m_generation = generation;
+			if (mode == ECounters_OFF)
+				return 0;
+
+			auto size = (size_t) sysconf(_SC_PAGESIZE);
+			m_user = true;
+			for (unsigned int i = 0; i < MAX_COUNTERS; ++i)
+			{
+				auto& e = s_events[mode][i];
+
+				perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = e.type;
+				attr.config = e.config;
+				attr.read_format = PERF_FORMAT_GROUP;
+				attr.exclude_kernel = e.type == PERF_TYPE_HARDWARE; // allowed with perf_event_paranoid 2
+				attr.exclude_hv = 1;
+
+				int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, leader(), 0);
+				if (fd < 0)
+					continue;
+
+				void* page = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+				m_page[i] = page == MAP_FAILED ? nullptr : (perf_event_mmap_page*) page;
+				if (!m_page[i] || !m_page[i]->cap_user_rdpmc)
+					m_user = false;
+
+				m_fd[i] = fd;
+				m_order[m_opened++] = i;
+				m_mask |= 1u << i;
+			}
+
+			if (!m_opened)
+				m_user = false;
+
+			return m_mask;
+		}
+
+		bool read(sample& out)
+		{
+			out.mask = 0;
+			if (!m_mask)
+				return false;
+
+			bool user = m_user;
+			for (unsigned int i = 0; user && i < m_opened; ++i)
+				user = read_user(m_page[m_order[i]], out.value[m_order[i]]);
+
+			if (!user)
+			{
+				unsigned long long values[1 + MAX_COUNTERS]; // nr, then the values in the opening order
+				auto size = (ssize_t) ((1 + m_opened) * sizeof(values[0]));
+				if (::read(leader(), values, size) != size)
+					return false;
+
+				for (unsigned int i = 0; i < m_opened; ++i)
+					out.value[m_order[i]] = values[1 + i];
+			}
+
+			out.mask = m_mask;
+			return true;
+		}
+	};
+
+	// thread_local rather than threads::get(), to close the descriptors
+	// when the thread exits
+	static thread_local thread_counters t_counters;
+
+	ECounters start(ECounters preferred)
+	{
+		if (s_mode.load() != ECounters_OFF)
+			return (ECounters) s_mode.load();
+
+		for (auto mode = preferred; mode != ECounters_OFF; mode = mode == ECounters_HARDWARE ? ECounters_SOFTWARE : ECounters_OFF)
+		{
+			thread_counters test;
+			auto mask = test.open(mode, 0);
+			if (!mask)
+				continue;
+
+			s_mask = mask;
+			s_generation.fetch_add(1);
+			s_mode.store(mode);
+			return mode;
+		}
+
+		return ECounters_OFF;
+	}
+
+	void stop()
+	{
+		s_mode.store(ECounters_OFF);
+	}
+
+	ECounters mode() { return (ECounters) s_mode.load(std::memory_order_relaxed); }
+
+	const char* name(unsigned int counter)
+	{
+		auto m = mode();
+		if (m == ECounters_OFF || counter >= MAX_COUNTERS || !(s_mask & (1u << counter)))
+			return nullptr;
+		return s_events[m][counter].name;
+	}
+
+	bool read(sample& out)
+	{
+		auto m = mode();
+		if (m == ECounters_OFF)
+			return false;
+
+		auto& counters = t_counters;
+		auto generation = s_generation.load(std::memory_order_relaxed);
+		if (counters.generation() != generation)
+			counters.open(m, generation);
+
+		out.generation = generation;
+		return counters.read(out);
+	}
+
+}} // profile::counters
+
+#endif // FEATURE_IO_WRITE
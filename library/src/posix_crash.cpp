@@ -0,0 +1,236 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/crash.hpp"
+#include "binary.hpp"
+
+#ifdef FEATURE_MT_ENABLED
+#include "threads.hpp"
+#endif // FEATURE_MT_ENABLED
+
+#include <cstring>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace profile { namespace crash {
+
+	using namespace io::binary;
+
+	enum
+	{
+		BUFFER_SIZE = 64 * 1024,
+		ALT_STACK_SIZE = 64 * 1024
+	};
+
+	static const int s_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+	static int s_fd = -1;
+	static collecting::session* s_session = nullptr;
+	static time::type s_second = 0;
+	static std::string s_path;
+	static struct sigaction s_previous[sizeof(s_signals) / sizeof(s_signals[0])];
+	static char s_alt_stack[ALT_STACK_SIZE];
+
+	// write() through a static buffer
+	class output
+	{
+		char m_buffer[BUFFER_SIZE];
+		size_t m_used;
+
+	public:
+		output(): m_used(0) {}
+
+		void flush()
+		{
+			const char* data = m_buffer;
+			while (m_used)
+			{
+				auto written = ::write(s_fd, data, m_used);
+				if (written < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					break;
+				}
+				data += written;
+				m_used -= written;
+			}
+			m_used = 0;
+		}
+
+		void put(const void* data, size_t size)
+		{
+			auto bytes = (const char*) data;
+			while (size)
+			{
+				auto chunk = BUFFER_SIZE - m_used;
+				if (chunk > size)
+					chunk = size;
+				memcpy(m_buffer + m_used, bytes, chunk);
+				m_used += chunk;
+				bytes += chunk;
+				size -= chunk;
+				if (m_used == BUFFER_SIZE)
+					flush();
+			}
+		}
+
+		template <typename T>
+		void put(const T& t) { put(&t, sizeof(t)); }
+	};
+
+	static output s_output;
+
+	static void dump_functions(const collecting::session& session)
+	{
+		for (auto& f : session)
+		{
+			for (auto& s : f)
+			{
+				dump::function fun = { s.id(), (u32) strlen(f.nice()), s.name() ? (u32) strlen(s.name()) : 0, 0 };
+				file::block b = { dump::BLOCK_FUNCTION, (u32) (sizeof(fun) + fun.name + fun.suffix) };
+				s_output.put(b);
+				s_output.put(fun);
+				s_output.put(f.nice(), fun.name);
+				s_output.put(s.name(), fun.suffix);
+
+				u64 count = 0;
+				for (auto& c : s)
+					(void)(c), ++count;
+
+				// another thread may add more meanwhile; they are left out
+				auto it = s.begin();
+				while (count)
+				{
+					u32 chunk = count < dump::CALLS_PER_BLOCK ? (u32) count : dump::CALLS_PER_BLOCK;
+					count -= chunk;
+
+					b.tag = dump::BLOCK_CALLS;
+					b.size = chunk * (u32) sizeof(dump::call);
+					s_output.put(b);
+					for (; chunk; --chunk, ++it)
+					{
+						auto& c = *it;
+						dump::call _c = { c.id(), c.parent(), c.function(), c.flags(), c.duration(), c.hasSelf() ? c.self() : file::NO_SELF };
+						s_output.put(_c);
+					}
+				}
+			}
+		}
+	}
+
+	static void dump_open(unsigned int index, collecting::probe* curr)
+	{
+		u32 depth = 0;
+		for (auto p = curr; p; p = p->prev)
+		{
+			if (p->m_session == s_session && p->m_admit != EAdmit_SKIP && !p->m_inherited)
+				++depth;
+		}
+
+		if (!depth)
+			return;
+
+		file::block b = { dump::BLOCK_OPEN, (u32) (sizeof(dump::thread) + depth * sizeof(dump::open)) };
+		dump::thread thread = { index, depth };
+		s_output.put(b);
+		s_output.put(thread);
+		for (auto p = curr; p && depth; p = p->prev)
+		{
+			if (p->m_session != s_session || p->m_admit == EAdmit_SKIP || p->m_inherited)
+				continue;
+
+			// the duration of an open call still holds its start
+			dump::open open = { p->m_call.id(), p->m_call.function(), 0, p->m_call.duration() };
+			s_output.put(open);
+			--depth;
+		}
+	}
+
+	static void dump_session(int signal)
+	{
+		dump::header h = { dump::VERSION, (u32) signal, s_second, time::now() };
+		s_output.put(dump::MAGIC);
+		s_output.put(h);
+
+		// the crashing thread may well be the one holding the lock
+		s_session->inspect(dump_functions);
+
+#ifdef FEATURE_MT_ENABLED
+		mt::threads::inspect([](mt::curr& thread) { dump_open(thread.m_index, thread.m_curr); });
+#else
+		dump_open(0, collecting::probe::curr());
+#endif // FEATURE_MT_ENABLED
+
+		s_output.flush();
+	}
+
+	static void on_crash(int signal)
+	{
+		auto saved = errno;
+		if (s_fd >= 0)
+		{
+			dump_session(signal);
+			::close(s_fd);
+			s_fd = -1;
+		}
+		errno = saved;
+
+		// SA_RESETHAND put the default action back; it takes over, as
+		// soon as the handler returns
+		raise(signal);
+	}
+
+	bool install(const char* path, collecting::session& session)
+	{
+		if (s_fd >= 0)
+			return false;
+
+		s_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (s_fd < 0)
+			return false;
+
+		s_path = path;
+		s_session = &session;
+		s_second = time::second();
+
+		// a stack overflow leaves no stack for the handler; this only
+		// helps the thread calling install()
+		stack_t alt;
+		alt.ss_sp = s_alt_stack;
+		alt.ss_size = sizeof(s_alt_stack);
+		alt.ss_flags = 0;
+		sigaltstack(&alt, nullptr);
+
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = on_crash;
+		action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+		sigemptyset(&action.sa_mask);
+
+		for (size_t i = 0; i < sizeof(s_signals) / sizeof(s_signals[0]); ++i)
+			sigaction(s_signals[i], &action, &s_previous[i]);
+
+		return true;
+	}
+
+	void uninstall()
+	{
+		if (s_fd < 0)
+			return;
+
+		for (size_t i = 0; i < sizeof(s_signals) / sizeof(s_signals[0]); ++i)
+			sigaction(s_signals[i], &s_previous[i], nullptr);
+
+		::close(s_fd);
+		s_fd = -1;
+		unlink(s_path.c_str());
+	}
+
+}} // profile::crash
+
+#endif // FEATURE_IO_WRITE
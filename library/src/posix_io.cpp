@@ -0,0 +1,32 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace profile { namespace collecting {
+
+	EFdClass io_probe::classify(int fd)
+	{
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st))
+			return EFdClass_UNKNOWN;
+
+		if (S_ISREG(st.st_mode))
+			return EFdClass_FILE;
+		if (S_ISFIFO(st.st_mode))
+			return EFdClass_PIPE;
+		if (S_ISSOCK(st.st_mode))
+			return EFdClass_SOCKET;
+		if (S_ISCHR(st.st_mode))
+			return isatty(fd) ? EFdClass_TTY : EFdClass_DEVICE;
+		if (S_ISBLK(st.st_mode))
+			return EFdClass_DEVICE;
+
+		return EFdClass_UNKNOWN;
+	}
+
+}} // profile::collecting
+
+#endif // FEATURE_IO_WRITE
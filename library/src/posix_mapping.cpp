@@ -0,0 +1,48 @@
+#ifdef FEATURE_IO_READ
+
+#include "mapping.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace profile { namespace io {
+
+	bool mapped_file::open(const char* path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) || !st.st_size)
+		{
+			::close(fd);
+			return false;
+		}
+
+		// the mapping stays, when the descriptor is gone
+		void* data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+			return false;
+
+		m_data = (const char*) data;
+		m_size = (size_t) st.st_size;
+		return true;
+	}
+
+	void mapped_file::close()
+	{
+		if (m_data)
+			munmap((void*) m_data, m_size);
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
@@ -0,0 +1,41 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/process.hpp"
+
+#include <pthread.h>
+#include <unistd.h>
+
+namespace profile { namespace process {
+
+	static bool s_forked = false;
+
+	unsigned int id() { return (unsigned int) getpid(); }
+	unsigned int parent() { return (unsigned int) getppid(); }
+	bool forked() { return s_forked; }
+
+	static void prepare()
+	{
+		collecting::session::before_fork();
+	}
+
+	static void in_parent()
+	{
+		collecting::session::after_fork(false);
+	}
+
+	static void in_child()
+	{
+		s_forked = true;
+		collecting::session::after_fork(true);
+	}
+
+	bool watch_forks()
+	{
+		static bool installed = !pthread_atfork(prepare, in_parent, in_child);
+		return installed;
+	}
+
+}} // profile::process
+
+#endif // FEATURE_IO_WRITE
@@ -0,0 +1,566 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/sampler.hpp"
+
+#include <atomic>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <link.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace profile { namespace sampling {
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SAMPLER_FRAME_POINTERS
+#endif
+
+	enum
+	{
+#ifdef SAMPLER_FRAME_POINTERS
+		// the walk starts at the interrupted instruction
+		SKIP_FRAMES = 0
+#else
+		// on_sigprof and the kernel's signal trampoline
+		SKIP_FRAMES = 2
+#endif
+	};
+
+	struct sample
+	{
+		int depth;
+		void* frames[MAX_DEPTH];
+	};
+
+	struct buffer
+	{
+		std::vector<sample> samples;
+		std::atomic<size_t> used;
+		std::atomic<unsigned long long> dropped;
+		pthread_t thread;
+		pid_t tid;
+		timer_t timer;
+		bool has_timer;
+		uintptr_t stack_bottom; // both zero, if not known
+		uintptr_t stack_top;
+
+		// made by the thread it is for
+		buffer(size_t size)
+			: samples(size)
+			, used(0)
+			, dropped(0)
+			, thread(pthread_self())
+			, tid((pid_t) syscall(SYS_gettid))
+			, has_timer(false)
+			, stack_bottom(0)
+			, stack_top(0)
+		{
+			pthread_attr_t attr;
+			if (pthread_getattr_np(thread, &attr))
+				return;
+
+			void* addr;
+			size_t stack_size;
+			if (!pthread_attr_getstack(&attr, &addr, &stack_size))
+			{
+				stack_bottom = (uintptr_t) addr;
+				stack_top = stack_bottom + stack_size;
+			}
+			pthread_attr_destroy(&attr);
+		}
+	};
+
+#ifdef SAMPLER_FRAME_POINTERS
+	enum
+	{
+		MAX_TEXTS = 512
+	};
+
+	// The executable segments of the modules loaded, for the handler to
+	// tell a return address from any other word on the stack. Filled in
+	// by start() and attach(), under the lock of the sampler, and only
+	// ever growing, so the handler reads it without one.
+	struct text
+	{
+		uintptr_t from;
+		uintptr_t to;
+	};
+
+	static text s_texts[MAX_TEXTS];
+	static std::atomic<size_t> s_text_count(0);
+
+	static int add_texts(dl_phdr_info* info, size_t, void*)
+	{
+		for (int i = 0; i < info->dlpi_phnum; ++i)
+		{
+			auto& ph = info->dlpi_phdr[i];
+			if (ph.p_type != PT_LOAD || !(ph.p_flags & PF_X))
+				continue;
+
+			text t = { (uintptr_t) (info->dlpi_addr + ph.p_vaddr), (uintptr_t) (info->dlpi_addr + ph.p_vaddr + ph.p_memsz) };
+			size_t count = s_text_count.load(std::memory_order_relaxed);
+			bool known = false;
+			for (size_t j = 0; j < count && !known; ++j)
+				known = s_texts[j].from == t.from && s_texts[j].to == t.to;
+
+			if (known || count == MAX_TEXTS)
+				continue;
+
+			s_texts[count] = t;
+			s_text_count.store(count + 1, std::memory_order_release);
+		}
+		return 0;
+	}
+
+	static bool in_text(uintptr_t pc)
+	{
+		size_t count = s_text_count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (pc >= s_texts[i].from && pc < s_texts[i].to)
+				return true;
+		}
+		return false;
+	}
+
+	// Walks the frame pointers from the interrupted context, as backtrace()
+	// is not safe in a signal handler. Only the part of the stack in use,
+	// between the stack pointer and the top, is read; code built without
+	// frame pointers cuts the stack short, where the word taken for the
+	// return address points outside of the code loaded.
+	static int unwind(const buffer& buf, void* context, void** frames, int max)
+	{
+		auto& mc = ((ucontext_t*) context)->uc_mcontext;
+#if defined(__x86_64__)
+		uintptr_t pc = mc.gregs[REG_RIP], fp = mc.gregs[REG_RBP], sp = mc.gregs[REG_RSP];
+#else
+		uintptr_t pc = mc.pc, fp = mc.regs[29], sp = mc.sp;
+#endif
+
+		int depth = 0;
+		frames[depth++] = (void*) pc;
+		if (sp < buf.stack_bottom || sp >= buf.stack_top)
+			return depth; // on another stack
+
+		// each frame holds the one of its caller, then the return address
+		while (depth < max && fp >= sp && fp % sizeof(uintptr_t) == 0 && fp + 2 * sizeof(uintptr_t) <= buf.stack_top)
+		{
+			auto frame = (const uintptr_t*) fp;
+			if (!in_text(frame[1]))
+				break;
+
+			frames[depth++] = (void*) frame[1];
+			sp = fp + 1; // the callers are further up
+			fp = frame[0];
+		}
+		return depth;
+	}
+#endif // SAMPLER_FRAME_POINTERS
+
+	static thread_local buffer* t_buffer = nullptr;
+
+	// The handler stays installed after stop(), as a tick may still be
+	// pending; it takes samples only while s_running is set, and stop()
+	// waits for the ones in flight to leave, before folding the buffers.
+	static std::atomic<bool> s_running(false);
+	static std::atomic<int> s_inside(0);
+	static std::atomic<unsigned long long> s_unattached(0); // ticks of the itimer on threads with no buffer
+
+	class sampler
+	{
+		std::mutex m_barrier;
+		std::list<buffer> m_buffers;
+		unsigned int m_frequency;
+		bool m_installed;
+		bool m_running;
+		bool m_itimer;
+
+		sampler(): m_frequency(DEFAULT_FREQUENCY), m_installed(false), m_running(false), m_itimer(false) {}
+
+		static void on_sigprof(int, siginfo_t*, void* context)
+		{
+			int saved = errno;
+			s_inside.fetch_add(1);
+
+			bool running = s_running;
+			buffer* buf = running ? t_buffer : nullptr;
+			if (running && !buf)
+				s_unattached.fetch_add(1, std::memory_order_relaxed);
+			else if (buf)
+			{
+				size_t at = buf->used.load(std::memory_order_relaxed);
+				if (at < buf->samples.size())
+				{
+					auto& s = buf->samples[at];
+#ifdef SAMPLER_FRAME_POINTERS
+					s.depth = unwind(*buf, context, s.frames, MAX_DEPTH);
+#else
+					(void)(context);
+					s.depth = backtrace(s.frames, MAX_DEPTH);
+#endif // SAMPLER_FRAME_POINTERS
+					buf->used.store(at + 1, std::memory_order_release);
+				}
+				else
+					buf->dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			s_inside.fetch_sub(1);
+			errno = saved;
+		}
+
+		timespec period() const
+		{
+			const long long NSEC = 1000000000LL;
+			long long ns = NSEC / m_frequency;
+			if (!ns)
+				ns = 1;
+
+			timespec ts;
+			ts.tv_sec = (time_t) (ns / NSEC);
+			ts.tv_nsec = (long) (ns % NSEC);
+			return ts;
+		}
+
+		// per-thread CPU clock timer, signalling exactly the owning thread
+		bool arm(buffer& buf)
+		{
+			clockid_t clock;
+			if (pthread_getcpuclockid(buf.thread, &clock))
+				return false;
+
+			sigevent ev = {};
+			ev.sigev_notify = SIGEV_THREAD_ID;
+			ev.sigev_signo = SIGPROF;
+			ev.sigev_notify_thread_id = buf.tid;
+			if (timer_create(clock, &ev, &buf.timer))
+				return false;
+
+			itimerspec spec;
+			spec.it_interval = spec.it_value = period();
+			if (timer_settime(buf.timer, 0, &spec, nullptr))
+			{
+				timer_delete(buf.timer);
+				return false;
+			}
+
+			buf.has_timer = true;
+			return true;
+		}
+
+		void disarm(buffer& buf)
+		{
+			if (!buf.has_timer)
+				return;
+
+			timer_delete(buf.timer);
+			buf.has_timer = false;
+		}
+
+		// process-wide fallback, when per-thread timers are not available
+		bool arm_itimer()
+		{
+			auto ts = period();
+			itimerval spec;
+			spec.it_interval.tv_sec = ts.tv_sec;
+			spec.it_interval.tv_usec = ts.tv_nsec / 1000;
+			if (!spec.it_interval.tv_sec && !spec.it_interval.tv_usec)
+				spec.it_interval.tv_usec = 1;
+			spec.it_value = spec.it_interval;
+			return m_itimer = !setitimer(ITIMER_PROF, &spec, nullptr);
+		}
+
+		void disarm_itimer()
+		{
+			if (!m_itimer)
+				return;
+
+			itimerval spec = {};
+			setitimer(ITIMER_PROF, &spec, nullptr);
+			m_itimer = false;
+		}
+
+		buffer& attach_locked(size_t samples)
+		{
+			if (!t_buffer)
+			{
+				m_buffers.emplace_back(samples);
+				t_buffer = &m_buffers.back();
+			}
+			return *t_buffer;
+		}
+
+	public:
+		static sampler& inst()
+		{
+			static sampler _;
+			return _;
+		}
+
+		bool start(unsigned int frequency)
+		{
+			std::lock_guard<std::mutex> guard(m_barrier);
+			(void)(guard);
+
+			if (m_running || !frequency)
+				return false;
+
+#ifndef SAMPLER_FRAME_POINTERS
+			// backtrace() loads libgcc on first use, which is not something
+			// to do inside a signal handler
+			void* prime[1];
+			backtrace(prime, 1);
+#endif // SAMPLER_FRAME_POINTERS
+
+			m_frequency = frequency;
+			attach_locked(DEFAULT_SAMPLES);
+#ifdef SAMPLER_FRAME_POINTERS
+			dl_iterate_phdr(add_texts, nullptr);
+#endif // SAMPLER_FRAME_POINTERS
+
+			if (!m_installed)
+			{
+				struct sigaction sa = {};
+				sa.sa_sigaction = on_sigprof;
+				sa.sa_flags = SA_SIGINFO | SA_RESTART;
+				sigemptyset(&sa.sa_mask);
+				if (sigaction(SIGPROF, &sa, nullptr))
+					return false;
+				m_installed = true;
+			}
+
+			s_running = true;
+
+			bool armed = true;
+			for (auto&& buf : m_buffers)
+				armed = armed && arm(buf);
+
+			if (!armed)
+			{
+				for (auto&& buf : m_buffers)
+					disarm(buf);
+
+				if (!arm_itimer())
+				{
+					s_running = false;
+					return false;
+				}
+			}
+
+			m_running = true;
+			return true;
+		}
+
+		void attach(size_t samples)
+		{
+			std::lock_guard<std::mutex> guard(m_barrier);
+			(void)(guard);
+
+			auto& buf = attach_locked(samples);
+#ifdef SAMPLER_FRAME_POINTERS
+			// the modules loaded since start()
+			dl_iterate_phdr(add_texts, nullptr);
+#endif // SAMPLER_FRAME_POINTERS
+			if (m_running && !m_itimer && !buf.has_timer)
+				arm(buf);
+		}
+
+		void stop()
+		{
+			std::lock_guard<std::mutex> guard(m_barrier);
+			(void)(guard);
+
+			if (!m_running)
+				return;
+
+			s_running = false;
+			disarm_itimer();
+			for (auto&& buf : m_buffers)
+				disarm(buf);
+
+			while (s_inside.load())
+				std::this_thread::yield();
+			m_running = false;
+
+			fold();
+		}
+
+		unsigned long long dropped()
+		{
+			std::lock_guard<std::mutex> guard(m_barrier);
+			(void)(guard);
+
+			unsigned long long ret = s_unattached.load(std::memory_order_relaxed);
+			for (auto&& buf : m_buffers)
+				ret += buf.dropped.load(std::memory_order_relaxed);
+			return ret;
+		}
+
+	private:
+		struct symbol
+		{
+			const char* name;
+			const char* nice;
+		};
+
+		struct node
+		{
+			size_t parent;
+			void* function;
+			unsigned long long count;
+		};
+
+		std::map<void*, symbol> m_symbols;
+		std::deque<std::string> m_names; // storage for names the profile points to
+
+		const char* keep(const std::string& s)
+		{
+			m_names.push_back(s);
+			return m_names.back().c_str();
+		}
+
+		// resolves the return address to the start of its function, so all
+		// samples within one function land in the same node
+		void* resolve(void* pc)
+		{
+			Dl_info info;
+			if (!dladdr(pc, &info) || !info.dli_saddr)
+				return pc;
+
+			void* start = info.dli_saddr;
+			if (m_symbols.find(start) != m_symbols.end())
+				return start;
+
+			symbol sym;
+			if (info.dli_sname)
+			{
+				sym.name = info.dli_sname;
+				int status = 0;
+				char* nice = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+				sym.nice = nice && !status ? keep(nice) : info.dli_sname;
+				free(nice);
+			}
+			else
+			{
+				char name[64];
+				sprintf(name, "%p", start);
+				sym.name = sym.nice = keep(name);
+			}
+
+			m_symbols[start] = sym;
+			return start;
+		}
+
+		symbol lookup(void* function)
+		{
+			auto it = m_symbols.find(function);
+			if (it != m_symbols.end())
+				return it->second;
+
+			Dl_info info;
+			std::string name;
+			char address[64];
+			sprintf(address, "%p", function);
+			if (dladdr(function, &info) && info.dli_fname)
+				name.append(info.dli_fname).append("!");
+			name.append(address);
+
+			symbol sym;
+			sym.name = sym.nice = keep(name);
+			m_symbols[function] = sym;
+			return sym;
+		}
+
+		void fold()
+		{
+			std::vector<node> tree;
+			std::map<std::pair<size_t, void*>, size_t> index;
+
+			for (auto&& buf : m_buffers)
+			{
+				size_t used = buf.used.load(std::memory_order_acquire);
+				for (size_t i = 0; i < used; ++i)
+				{
+					auto& s = buf.samples[i];
+					size_t parent = (size_t) -1;
+					for (int frame = s.depth - 1; frame >= SKIP_FRAMES; --frame)
+					{
+						// return addresses point past the call, the leaf
+						// is the interrupted instruction itself
+						char* pc = (char*) s.frames[frame];
+						if (frame > SKIP_FRAMES)
+							--pc;
+
+						void* function = resolve(pc);
+						auto key = std::make_pair(parent, function);
+						auto it = index.find(key);
+						if (it == index.end())
+						{
+							node n = { parent, function, 0 };
+							it = index.insert(std::make_pair(key, tree.size())).first;
+							tree.push_back(n);
+						}
+
+						parent = it->second;
+						++tree[parent].count;
+					}
+				}
+
+				buf.used.store(0, std::memory_order_release);
+			}
+
+			if (tree.empty())
+				return;
+
+			time::type period = time::second() / m_frequency;
+			auto& profile = collecting::probe::profile();
+			std::vector<call_id> ids(tree.size());
+
+			// the samples of a node count in all the nodes above it, too
+			std::vector<unsigned long long> below(tree.size());
+			for (auto&& n : tree)
+			{
+				if (n.parent != (size_t) -1)
+					below[n.parent] += n.count;
+			}
+
+			// parents are always created before their children
+			for (size_t i = 0; i < tree.size(); ++i)
+			{
+				auto& n = tree[i];
+				auto sym = lookup(n.function);
+				auto parent = n.parent != (size_t) -1 ? ids[n.parent] : 0;
+				ids[i] = profile.call(sym.name, sym.nice, "", ECallFlag_SAMPLED, parent, n.count * period, (n.count - below[i]) * period);
+			}
+		}
+	};
+
+	bool start(unsigned int frequency) { return sampler::inst().start(frequency); }
+	void attach(size_t samples) { sampler::inst().attach(samples); }
+	void stop() { sampler::inst().stop(); }
+	unsigned long long dropped() { return sampler::inst().dropped(); }
+
+}} // profile::sampling
+
+#endif // FEATURE_IO_WRITE
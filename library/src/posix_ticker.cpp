@@ -0,0 +1,20 @@
+#include "profile/ticker.hpp"
+#include <time.h>
+
+namespace profile
+{
+    namespace time
+    {
+        type now()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (type) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+
+        type second()
+        {
+            return 1000000000ull;
+        }
+    }
+}
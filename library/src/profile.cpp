@@ -2,60 +2,19 @@
 
 #include <string>
 #include <fstream>
+#include <unordered_set>
 
 #ifdef FEATURE_MT_ENABLED
-#include <thread>
-#include <list>
+#include "threads.hpp"
 #endif // FEATURE_MT_ENABLED
 
+#ifdef FEATURE_IO_WRITE
+#include "profile/governor.hpp"
+#include "profile/process.hpp"
+#endif // FEATURE_IO_WRITE
+
 namespace profile
 {
-#ifdef FEATURE_MT_ENABLED
-
-	namespace mt
-	{
-		struct curr
-		{
-			collecting::probe* m_curr;
-			std::thread::id m_id;
-			curr(): m_curr(nullptr), m_id(std::this_thread::get_id()) {}
-
-			bool operator == (const std::thread::id& id) const { return m_id == id; }
-		};
-
-		class threads
-		{
-			std::list<curr> m_sinks;
-			spin_lock m_barrier;
-
-			static threads& inst()
-			{
-				static threads _;
-				return _;
-			}
-
-		public:
-			static curr& get()
-			{
-				auto& i = inst();
-				std::lock_guard<spin_lock> guard(i.m_barrier);
-				(void)(guard); // "unused"
-
-				auto key = std::this_thread::get_id();
-				for (auto&& sink: i.m_sinks)
-				{
-					if (sink == key)
-						return sink;
-				}
-
-				i.m_sinks.push_back(curr());
-				return i.m_sinks.back();
-			}
-		};
-	}
-
-#endif // FEATURE_MT_ENABLED
-
 	namespace collecting
 	{
 		call::call(call_id call, function_id fn, unsigned int flags)
@@ -64,21 +23,25 @@ namespace profile
 			, m_fn(fn)
 			, m_flags(flags)
 			, m_duration(0)
+			, m_self(NO_SELF)
 		{
 		}
 
 #ifdef FEATURE_IO_READ
-		call::call(call_id call, call_id parent, function_id fn, unsigned int flags, time::type duration)
+		call::call(call_id call, call_id parent, function_id fn, unsigned int flags, time::type duration, time::type self)
 			: m_call(call)
 			, m_parent(parent)
 			, m_fn(fn)
 			, m_flags(flags)
 			, m_duration(duration)
+			, m_self(self)
 		{
 		}
 #endif // FEATURE_IO_READ
 
 		void call::set_parent(call_id parent) { m_parent = parent; }
+		void call::set_duration(time::type duration) { m_duration = duration; }
+		void call::set_self(time::type self) { m_self = self; }
 
 		void call::start()
 		{
@@ -90,19 +53,130 @@ namespace profile
 			m_duration = time::now() - m_duration;
 		}
 
-		function_id next_section()
+#ifdef FEATURE_IO_WRITE
+
+		struct session_list
 		{
-			static function_id next_id = 0;
-			return ++next_id;
+			std::vector<session*> items;
+#ifdef FEATURE_MT_ENABLED
+			mt::spin_lock barrier;
+#endif // FEATURE_MT_ENABLED
+
+			static session_list& get()
+			{
+				static session_list _;
+				return _;
+			}
+		};
+
+		session::session()
+		{
+			static bool watched = profile::process::watch_forks();
+			(void)(watched);
+
+			auto& list = session_list::get();
+#ifdef FEATURE_MT_ENABLED
+			std::lock_guard<mt::spin_lock> guard(list.barrier);
+			(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+			list.items.push_back(this);
 		}
 
-		call_id next_call()
+		session::~session()
 		{
-			static call_id next_id = 0;
-			return ++next_id;
+			auto& list = session_list::get();
+#ifdef FEATURE_MT_ENABLED
+			std::lock_guard<mt::spin_lock> guard(list.barrier);
+			(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+			list.items.erase(std::remove(list.items.begin(), list.items.end(), this), list.items.end());
 		}
 
-#ifdef FEATURE_IO_WRITE
+		// No lock may be left taken by a thread, which will not exist in
+		// the child, so all of them are held over the fork().
+		void session::before_fork()
+		{
+			auto& list = session_list::get();
+#ifdef FEATURE_MT_ENABLED
+			list.barrier.lock();
+			for (auto s : list.items)
+				s->barrier().lock();
+			mt::threads::lock();
+#endif // FEATURE_MT_ENABLED
+		}
+
+		void session::after_fork(bool child)
+		{
+			auto& list = session_list::get();
+#ifdef FEATURE_MT_ENABLED
+			if (child)
+				mt::threads::forked();
+			mt::threads::unlock();
+#endif // FEATURE_MT_ENABLED
+
+			for (auto s : list.items)
+			{
+				if (child)
+					s->forked();
+#ifdef FEATURE_MT_ENABLED
+				s->barrier().unlock();
+#endif // FEATURE_MT_ENABLED
+			}
+
+#ifdef FEATURE_MT_ENABLED
+			list.barrier.unlock();
+#endif // FEATURE_MT_ENABLED
+		}
+
+		// With the barrier taken. The open calls are all owned by the probes
+		// themselves; the ones of the forking thread are the parent's.
+		void session::forked()
+		{
+			clear_calls();
+			set_last_call((call_id) ::profile::process::id() << FORK_SHIFT);
+
+			for (auto p = probe::curr(); p; p = p->prev)
+			{
+				if (p->m_session != this)
+					continue;
+
+				p->m_inherited = true;
+				p->m_deferred.clear();
+				p->m_attributes.clear();
+			}
+		}
+
+		session& session::global()
+		{
+			static session _;
+			return _;
+		}
+
+		static session*& current_session()
+		{
+#ifdef FEATURE_MT_ENABLED
+			return mt::threads::get().m_session;
+#else
+			static session* _ = nullptr;
+			return _;
+#endif
+		}
+
+		session& session::current()
+		{
+			auto curr = current_session();
+			return curr ? *curr : global();
+		}
+
+		session* session::make_current(session* next)
+		{
+			auto& curr = current_session();
+			auto prev = curr;
+			curr = next;
+			return prev;
+		}
 
 		probe*& probe::curr()
 		{
@@ -114,28 +188,396 @@ namespace profile
 #endif
 		}
 
-		profile_type<const char*>& probe::profile()
+		session& probe::profile()
 		{
-			static collecting::profile_type<const char*> _;
-			return _;
+			return session::current();
 		}
 
-		probe::probe(const char* name, const char* nice, const char* suffix, unsigned int flags)
-			: m_call(profile().call(name, nice, suffix, flags))
+		probe* probe::outer(probe* from, const collecting::session* session)
+		{
+			while (from && from->m_session != session)
+				from = from->prev;
+			return from;
+		}
+
+		call_id probe::record(const char* name, const char* nice, const char* suffix, unsigned int flags, time::type duration)
+		{
+			auto& session = profile();
+			auto parent = outer(curr(), &session);
+
+			// spent within the time of the enclosing probe, but not as its own
+			if (parent)
+				parent->m_children += duration;
+
+			return session.call(name, nice, suffix, flags, parent ? parent->m_anchor : 0, duration, duration);
+		}
+
+		call_id probe::anchor(const collecting::session& session)
+		{
+			auto parent = outer(curr(), &session);
+			return parent ? parent->m_anchor : 0;
+		}
+
+		const char* probe::intern(const char* tag)
+		{
+#ifdef FEATURE_MT_ENABLED
+			static mt::spin_lock barrier;
+			std::lock_guard<mt::spin_lock> guard(barrier);
+			(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+			// nodes of the set never move, so the pointers stay valid
+			static std::unordered_set<std::string> tags;
+			return tags.insert(tag).first->c_str();
+		}
+
+		time::type probe::usec(unsigned long long us)
+		{
+			static time::type second = time::second();
+			return us * second / 1000000;
+		}
+
+		void probe::budget(const char* section, unsigned long long us)
+		{
+			profile().budget(intern(section), usec(us));
+		}
+
+		probe::probe(const char* name, const char* nice, const char* suffix, unsigned int flags, time::type budget)
+			: probe(session::current(), name, nice, suffix, flags, budget)
+		{
+		}
+
+		probe::probe(collecting::session& session, const char* name, const char* nice, const char* suffix, unsigned int flags, time::type budget)
+			: probe(session, name, nice, suffix, flags, budget, nullptr)
+		{
+		}
+
+		probe::probe(collecting::session& session, const char* name, const char* nice, const char* suffix, unsigned int flags, time::type budget, probe_extra* extra)
+			: m_session(&session)
 			, prev(curr())
+			, m_outer(outer(prev, &session))
+			, m_budget(budget)
+			, m_owner(budget ? this : m_outer ? m_outer->m_owner : nullptr)
+			, m_section(nullptr)
+			, m_admit(EAdmit_KEEP)
+			, m_call(open(name, nice, suffix, flags))
+			, m_anchor(m_admit != EAdmit_KEEP ? (m_outer ? m_outer->m_anchor : 0) : m_call.id())
+			, m_children(0)
+			, m_detached(false)
+			, m_inherited(false)
+			, m_counters()
+			, m_extra(extra)
 		{
 			curr() = this;
 
-			if (prev)
-				m_call.set_parent(prev->m_call.id());
+			if (m_outer)
+				m_call.set_parent(m_outer->m_anchor);
 
+			// skipped calls are not even timed, nor seen by the watchdog
+			if (m_admit == EAdmit_SKIP)
+				return;
+
+			counters::read(m_counters);
 			m_call.start();
+
+#ifdef FEATURE_MT_ENABLED
+			// the duration still holds the start time
+			mt::threads::get().m_stack.push(m_session, m_call.id(), m_call.function(), m_call.duration());
+#endif // FEATURE_MT_ENABLED
+		}
+
+		call probe::open(const char* name, const char* nice, const char* suffix, unsigned int flags)
+		{
+			auto& profile = *m_session;
+
+#ifdef FEATURE_MT_ENABLED
+			std::lock_guard<mt::spin_lock> guard(profile.barrier());
+			(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+			auto& section = profile.section(name, nice, suffix);
+			if (!m_budget)
+			{
+				m_budget = profile.budget(suffix);
+				if (m_budget)
+					m_owner = this;
+			}
+
+			if (!m_owner)
+			{
+				if (profile.governed())
+					m_admit = section.admit(!!(flags & ECallFlag_IO)); // I/O stats need the time
+			}
+
+			// Kept by the probe until finished, and only then added to the
+			// section: the writers may be walking the calls of the section
+			// meanwhile, or the rotator have moved them away.
+			m_section = &section;
+			return collecting::call(m_admit == EAdmit_SKIP ? 0 : profile.next_call(), section.id(), flags);
 		}
 
 		probe::~probe()
 		{
 			curr() = prev;
+
+			auto& profile = *m_session;
+			if (profile.governed())
+				governor::tick();
+
+			// counted when admitted
+			if (m_admit == EAdmit_SKIP)
+				return;
+
+#ifdef FEATURE_MT_ENABLED
+			mt::threads::get().m_stack.pop();
+#endif // FEATURE_MT_ENABLED
+
 			m_call.stop();
+			m_call.set_self(m_children < m_call.duration() ? m_call.duration() - m_children : 0);
+
+			if (m_extra)
+				m_extra->stopped(*this);
+
+			if (m_counters.mask)
+				count();
+
+			if (m_outer && !m_detached)
+				m_outer->m_children += m_call.duration();
+
+			if (m_inherited)
+			{
+				inherited();
+				return;
+			}
+
+			if (m_admit == EAdmit_COUNT)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(profile.barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_section->aggregate().add(m_call.duration(), m_call.self());
+				return;
+			}
+
+			if (!m_owner)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(profile.barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_section->add(m_call);
+				return;
+			}
+
+			if (m_owner != this)
+			{
+				deferred d = { m_section, m_call, false };
+				m_owner->m_deferred.push_back(d);
+				return;
+			}
+
+			settle();
+		}
+
+		// In a forked child, for a probe opened by the parent, which records
+		// the call itself. The calls the child deferred to it are kept.
+		void probe::inherited()
+		{
+			if (m_owner != this || m_deferred.empty())
+				return;
+
+			auto& profile = *m_session;
+#ifdef FEATURE_MT_ENABLED
+			std::lock_guard<mt::spin_lock> guard(profile.barrier());
+			(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+			for (auto& d : m_deferred)
+			{
+				if (!d.kept)
+					d.section->add(d.call);
+			}
+			for (auto& a : m_attributes)
+			{
+				if (a.isTag())
+					profile.m_attributes.add(a.call(), a.name(), a.tag());
+				else
+					profile.m_attributes.add(a.call(), a.name(), a.value());
+			}
+		}
+
+		void probe::settle()
+		{
+			auto outer = m_outer ? m_outer->m_owner : nullptr;
+			bool violated = m_call.duration() > m_budget;
+
+			// within an outer budget, the outer call decides what is kept
+			if (!violated && outer)
+			{
+				deferred d = { m_section, m_call, false };
+				outer->m_deferred.insert(outer->m_deferred.end(), m_deferred.begin(), m_deferred.end());
+				outer->m_deferred.push_back(d);
+				outer->m_attributes.insert(outer->m_attributes.end(), m_attributes.begin(), m_attributes.end());
+				return;
+			}
+
+			auto& profile = *m_session;
+
+			if (!violated)
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(profile.barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_section->aggregate().add(m_call.duration(), m_call.self());
+				for (auto& d : m_deferred)
+				{
+					if (!d.kept)
+						d.section->aggregate().add(d.call.duration(), d.call.self());
+				}
+				return;
+			}
+
+			violation v(m_call.id(), m_call.function(), m_call.duration(), m_budget);
+
+			std::vector<probe*> stack;
+			for (auto p = m_outer; p; p = p->m_outer)
+				stack.push_back(p);
+			for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+				v.push((*it)->m_call.id(), (*it)->m_call.function());
+
+			for (auto& d : m_deferred)
+			{
+				if (d.call.parent() == m_call.id())
+					v.child(d.call.id(), d.call.function());
+			}
+
+			{
+#ifdef FEATURE_MT_ENABLED
+				std::lock_guard<mt::spin_lock> guard(profile.barrier());
+				(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+				m_section->aggregate().violated(m_call.duration());
+				m_section->add(m_call);
+				for (auto& d : m_deferred)
+				{
+					if (!d.kept)
+						d.section->add(d.call);
+				}
+				for (auto& a : m_attributes)
+				{
+					if (a.isTag())
+						profile.m_attributes.add(a.call(), a.name(), a.tag());
+					else
+						profile.m_attributes.add(a.call(), a.name(), a.value());
+				}
+				profile.add_violation(v);
+			}
+
+			// already kept, the outer call only needs to know it was there
+			if (outer)
+			{
+				deferred d = { m_section, m_call, true };
+				outer->m_deferred.push_back(d);
+			}
+		}
+
+		// All of the counters go in at once, under one lock.
+		void probe::count()
+		{
+			counters::sample end;
+			if (!counters::read(end) || end.generation != m_counters.generation || m_admit != EAdmit_KEEP)
+				return;
+
+			const char* names[counters::MAX_COUNTERS];
+			unsigned long long values[counters::MAX_COUNTERS];
+			unsigned int count = 0;
+			for (unsigned int i = 0; i < counters::MAX_COUNTERS; ++i)
+			{
+				auto name = counters::name(i);
+				if (name && (m_counters.mask & end.mask & (1u << i)))
+				{
+					names[count] = name;
+					values[count++] = end.value[i] - m_counters.value[i];
+				}
+			}
+
+			if (m_owner)
+			{
+				for (unsigned int i = 0; i < count; ++i)
+					m_owner->m_attributes.emplace_back(m_call.id(), names[i], values[i]);
+				return;
+			}
+
+#ifdef FEATURE_MT_ENABLED
+			std::lock_guard<mt::spin_lock> guard(m_session->barrier());
+			(void)(guard);
+#endif // FEATURE_MT_ENABLED
+
+			for (unsigned int i = 0; i < count; ++i)
+				m_session->m_attributes.add(m_call.id(), names[i], values[i]);
+		}
+
+		probe& probe::attr(const char* name, unsigned long long value)
+		{
+			if (m_admit != EAdmit_KEEP)
+				return *this;
+
+			if (m_owner)
+				m_owner->m_attributes.emplace_back(m_call.id(), name, value);
+			else
+				m_session->attribute(m_call.id(), name, value);
+			return *this;
+		}
+
+		probe& probe::tag(const char* name, const char* value)
+		{
+			if (m_admit != EAdmit_KEEP)
+				return *this;
+
+			if (m_owner)
+				m_owner->m_attributes.emplace_back(m_call.id(), name, intern(value));
+			else
+				m_session->attribute(m_call.id(), name, intern(value));
+			return *this;
+		}
+
+		static EFdClass fd_class(EIoOp op, int fd)
+		{
+			switch (op)
+			{
+			case EIoOp_SEND:
+			case EIoOp_RECV:
+				return EFdClass_SOCKET;
+			case EIoOp_FSYNC:
+				return EFdClass_FILE;
+			default:
+				return io_probe::classify(fd);
+			}
+		}
+
+		void io_transfer::stopped(probe& p)
+		{
+			p.attr("bytes", m_bytes);
+			p.m_session->io(p.m_call.function(), m_op, m_fd, m_bytes, p.m_call.duration());
+		}
+
+		// the fd is classified by the io_transfer, before the probe starts
+		io_probe::io_probe(const char* name, const char* nice, const char* suffix, EIoOp op, int fd)
+			: io_transfer(op, fd_class(op, fd))
+			, probe(session::current(), name, nice, suffix, ECallFlag_SYSCALL | ECallFlag_IO, 0, this)
+		{
+		}
+
+		io_probe& io_probe::bytes(unsigned long long count)
+		{
+			m_bytes += count;
+			return *this;
 		}
 #endif // FEATURE_IO_WRITE
 	}
@@ -1,6 +1,7 @@
 #ifdef FEATURE_IO_READ
 
 #include <profile/read.hpp>
+#include <profile/columns.hpp>
 #include "binary.hpp"
 #include <fstream>
 
@@ -16,24 +17,33 @@ namespace profile { namespace io {
 		bool read(std::istream& is, file_contents& out, int flags);
 	}
 
-	bool is_binary(std::istream& s)
+	static unsigned long long magic(std::istream& s)
 	{
-		using namespace io::binary;
-
 		auto pos = s.tellg();
-		u64 magic = 0;
+		unsigned long long magic = 0;
 		if (!io::binary::read(s, magic))
-			return false;
+			return 0;
 
 		s.seekg(pos);
 
-		return magic == file::MAGIC;
+		return magic;
+	}
+
+	bool is_binary(std::istream& s)
+	{
+		return magic(s) == binary::file::MAGIC;
 	}
 
 	bool read(const char* path, file_contents& out, unsigned int flags)
 	{
 		std::ifstream is(path, std::ios::in | std::ios::binary);
 
+		if (magic(is) == binary::columnar::MAGIC)
+		{
+			columns file;
+			return file.open(path) && binary::read_columns(file, out, flags);
+		}
+
 		if (is_binary(is))
 			return binary::read(is, out, flags);
 		else
@@ -2,11 +2,17 @@
 
 #include <profile/read.hpp>
 #include "binary.hpp"
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include "reader.hpp"
 
+#ifdef FEATURE_MT_ENABLED
+#include <atomic>
+#include <thread>
+#endif // FEATURE_MT_ENABLED
+
 namespace profile { namespace io { namespace binary {
 
 	std::string str(const std::vector<char>& strings, u32 offset)
@@ -17,6 +23,349 @@ namespace profile { namespace io { namespace binary {
 		return std::string(&strings[offset]);
 	}
 
+	// The blocks following the calls, up to the end of the file, or up
+	// to left bytes, with the call ids as wide as Ids lays them out. The
+	// self times of 1.0 go to self, the rest to the builder.
+	template <typename Ids>
+	static bool read_blocks(std::istream& is, u64 left, const std::vector<char>& strings, reader::profile& builder, size_t call_count, std::vector<u64>& self)
+	{
+		typedef typename Ids::attribute attribute;
+		typedef typename Ids::frame frame;
+		typedef typename Ids::violation violation;
+		typedef typename Ids::process process;
+
+		file::block b;
+		while (left >= sizeof(b) && read(is, b))
+		{
+			if (b.size > left - sizeof(b))
+				return false;
+			left -= sizeof(b) + b.size;
+
+			switch (b.tag)
+			{
+			case file::BLOCK_SELF:
+				if (b.size != call_count * sizeof(u64))
+					return false;
+
+				self.resize(call_count);
+				if (!self.empty() && is.read((char*) &self[0], b.size).gcount() != b.size)
+					return false;
+				break;
+
+			case file::BLOCK_ATTRIBUTES:
+				if (b.size % sizeof(attribute))
+					return false;
+
+				for (u32 i = 0; i < b.size / sizeof(attribute); ++i)
+				{
+					attribute a;
+					if (!read(is, a))
+						return false;
+
+					if (a.type == EAttribute_TAG)
+						builder.attribute(a.call, str(strings, a.name), str(strings, a.tag));
+					else
+						builder.attribute(a.call, str(strings, a.name), a.value);
+				}
+				break;
+
+			case file::BLOCK_IO:
+				if (b.size % sizeof(file::io_stats))
+					return false;
+
+				for (u32 i = 0; i < b.size / sizeof(file::io_stats); ++i)
+				{
+					file::io_stats io;
+					if (!read(is, io))
+						return false;
+
+					builder.io(io.function, io.op, io.fd_class, io.calls, io.bytes, io.duration, io.histogram);
+				}
+				break;
+
+			case file::BLOCK_STALLS:
+				while (b.size)
+				{
+					file::stall st;
+					if (b.size < sizeof(st) || !read(is, st))
+						return false;
+					b.size -= sizeof(st);
+
+					if (b.size / sizeof(frame) < st.depth)
+						return false;
+					b.size -= st.depth * sizeof(frame);
+
+					collecting::stall out(st.thread, st.observed, st.open);
+					for (u32 i = 0; i < st.depth; ++i)
+					{
+						frame f;
+						if (!read(is, f))
+							return false;
+						out.push(f.call, f.function);
+					}
+
+					builder.stall(out);
+				}
+				break;
+
+			case file::BLOCK_AGGREGATES:
+				if (b.size % sizeof(file::aggregate))
+					return false;
+
+				for (u32 i = 0; i < b.size / sizeof(file::aggregate); ++i)
+				{
+					file::aggregate a;
+					if (!read(is, a))
+						return false;
+
+					collecting::aggregate out;
+					out.calls = a.calls;
+					out.duration = a.duration;
+					out.self = a.self;
+					out.longest = a.longest;
+					out.violations = a.violations;
+					out.skipped = a.skipped;
+					builder.aggregate(a.function, out);
+				}
+				break;
+
+			case file::BLOCK_VIOLATIONS:
+				while (b.size)
+				{
+					violation v;
+					if (b.size < sizeof(v) || !read(is, v))
+						return false;
+					b.size -= sizeof(v);
+
+					if (b.size / sizeof(frame) < (u64) v.depth + v.children)
+						return false;
+					b.size -= (v.depth + v.children) * sizeof(frame);
+
+					collecting::violation out(v.call, v.function, v.duration, v.budget);
+					for (u32 i = 0; i < v.depth + v.children; ++i)
+					{
+						frame f;
+						if (!read(is, f))
+							return false;
+						if (i < v.depth)
+							out.push(f.call, f.function);
+						else
+							out.child(f.call, f.function);
+					}
+
+					builder.violation(out);
+				}
+				break;
+
+			case file::BLOCK_DOWNGRADES:
+				if (b.size % sizeof(file::downgrade))
+					return false;
+
+				for (u32 i = 0; i < b.size / sizeof(file::downgrade); ++i)
+				{
+					file::downgrade d;
+					if (!read(is, d))
+						return false;
+
+					builder.downgrade(collecting::downgrade(d.function, (ERecording) d.recording, d.rate, d.at, d.hits, d.window));
+				}
+				break;
+
+			case file::BLOCK_PROCESSES:
+				if (b.size % sizeof(process))
+					return false;
+
+				for (u32 i = 0; i < b.size / sizeof(process); ++i)
+				{
+					process p;
+					if (!read(is, p))
+						return false;
+
+					builder.process(collecting::process(p.pid, p.parent, p.first, p.last));
+				}
+				break;
+
+			default:
+				if (is.ignore(b.size).gcount() != b.size)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool read_blocks(std::istream& is, u64 left, bool wide, const std::vector<char>& strings, reader::profile& builder, size_t call_count, std::vector<u64>& self)
+	{
+		if (wide)
+			return read_blocks<wide_ids>(is, left, strings, builder, call_count, self);
+		return read_blocks<narrow_ids>(is, left, strings, builder, call_count, self);
+	}
+
+	// Takes the chunks up to the end of the file, or up to the first one
+	// cut short, damaged or not making sense.
+	static bool read_chunks(std::istream& is, file_contents& out, int flags)
+	{
+		auto pos = is.tellg();
+		is.seekg(0, std::ios::end);
+		auto end = is.tellg();
+		is.seekg(pos);
+
+		reader::profile builder(out.m_profile);
+		std::vector<char> strings;
+
+		// built after the blocks, as in the files of 2.0
+		std::vector<call_record> calls;
+		std::vector<u64> self;
+
+		chunked::chunk c;
+		std::vector<char> payload;
+		while (read(is, c))
+		{
+			if (c.size > end - is.tellg())
+				break;
+
+			payload.resize(c.size);
+			if (c.size && is.read(&payload[0], c.size).gcount() != c.size)
+				break;
+
+			if (chunked::crc(c, payload.data()) != c.crc)
+				break;
+
+			bool ok = true;
+			switch (c.tag)
+			{
+			case chunked::CHUNK_STRINGS:
+			{
+				u32 offset;
+				ok = c.size > sizeof(offset) && !payload.back();
+				if (!ok)
+					break;
+
+				memcpy(&offset, &payload[0], sizeof(offset));
+				ok = offset == strings.size();
+				if (ok)
+					strings.insert(strings.end(), payload.begin() + sizeof(offset), payload.end());
+				break;
+			}
+
+			case chunked::CHUNK_FUNCTIONS:
+				ok = !(c.size % sizeof(file::function));
+				for (u32 i = 0; ok && i < c.size / sizeof(file::function); ++i)
+				{
+					file::function fun;
+					memcpy(&fun, &payload[i * sizeof(fun)], sizeof(fun));
+					ok = builder.function(fun.id, str(strings, fun.name), str(strings, fun.suffix), flags);
+				}
+				break;
+
+			case chunked::CHUNK_CALLS:
+			{
+				u32 count;
+				ok = c.size >= sizeof(count);
+				if (!ok)
+					break;
+
+				memcpy(&count, &payload[0], sizeof(count));
+				ok = count <= c.size / 6; // six values, a byte each at the least
+				if (!ok)
+					break;
+
+				auto data = (const unsigned char*) payload.data();
+				call_decoder decoder(data + sizeof(count), data + c.size);
+
+				std::vector<call_record> chunk(count);
+				std::vector<u64> chunk_self(count);
+				for (u32 i = 0; ok && i < count; ++i)
+					ok = decoder.decode(chunk[i], chunk_self[i]);
+
+				ok = ok && decoder.done();
+				if (ok)
+				{
+					calls.insert(calls.end(), chunk.begin(), chunk.end());
+					self.insert(self.end(), chunk_self.begin(), chunk_self.end());
+				}
+				break;
+			}
+
+			case chunked::CHUNK_BLOCKS:
+			case chunked::CHUNK_WIDE_BLOCKS:
+			{
+				std::istringstream blocks(std::string(payload.begin(), payload.end()));
+				std::vector<u64> ignored;
+				ok = read_blocks(blocks, c.size, c.tag == chunked::CHUNK_WIDE_BLOCKS, strings, builder, 0, ignored);
+				break;
+			}
+
+			default:
+				break;
+			}
+
+			if (!ok)
+				break;
+		}
+
+		for (size_t i = 0; i < calls.size(); ++i)
+		{
+			auto& c = calls[i];
+			if (!builder.call(c.id, c.parent, c.function, c.flags, c.duration, self[i], flags))
+				return false;
+		}
+
+		return true;
+	}
+
+	// How many blocks of calls are read ahead, to be unpacked together,
+	// one for each core.
+	static size_t unpack_window()
+	{
+#ifdef FEATURE_MT_ENABLED
+		size_t threads = std::thread::hardware_concurrency();
+		return threads ? threads : 2;
+#else
+		return 1;
+#endif // FEATURE_MT_ENABLED
+	}
+
+	// Unpacks the packed ones of the first count blocks into out, on a
+	// thread for each.
+	static bool unpack(const std::vector<std::vector<unsigned char>>& raw, const std::vector<u32>& tags, size_t count, u64 limit, std::vector<std::vector<unsigned char>>& out)
+	{
+#ifdef FEATURE_MT_ENABLED
+		std::atomic<size_t> next(0);
+		std::atomic<bool> ok(true);
+		auto worker = [&] {
+			for (size_t i = next++; i < count && ok; i = next++)
+			{
+				if (tags[i] == file::BLOCK_PACKED && !unpack_calls(raw[i], limit, out[i]))
+					ok = false;
+			}
+		};
+
+		size_t packed = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (tags[i] == file::BLOCK_PACKED)
+				++packed;
+		}
+
+		// this thread is one of the workers
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < packed; ++t)
+			pool.emplace_back(worker);
+		worker();
+		for (auto& thread : pool)
+			thread.join();
+		return ok;
+#else
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (tags[i] == file::BLOCK_PACKED && !unpack_calls(raw[i], limit, out[i]))
+				return false;
+		}
+		return true;
+#endif // FEATURE_MT_ENABLED
+	}
+
 	bool read(std::istream& is, file_contents& out, int flags)
 	{
 		u64 magic = 0xC0C0C0C0C0C0C0C0ull;
@@ -24,35 +373,43 @@ namespace profile { namespace io { namespace binary {
 			return false;
 
 		file::header h;
-		if (!read(is, h))
+		file::counts c;
+		if (!file::read_header(is, h, c))
 			return false;
 
-		if (h.version != file::VERSION)
-			return false;
+		if (!h.second)
+			h.second = 1;
 
-		if (h.function_offset % 4)
+		if (h.version == file::VERSION_CHUNKED)
+		{
+			out.m_second = h.second;
+			return read_chunks(is, out, flags);
+		}
+
+		if (h.version != file::VERSION && h.version != file::VERSION_WIDE && h.version != file::VERSION_1)
 			return false;
 
-		if ((h.call_offset - h.function_offset) / sizeof(file::function) != h.function_count)
+		// the string offsets are of 32 bits in either version
+		if (c.function_offset % 4 || c.function_offset > narrow_ids::LARGEST || c.call_offset < c.function_offset)
 			return false;
 
-		if (!h.second)
-			h.second = 1;
+		if ((c.call_offset - c.function_offset) / sizeof(file::function) != c.function_count)
+			return false;
 
 		out.m_second = h.second;
 
-		std::vector<char> strings(h.function_offset + 1);
+		std::vector<char> strings((size_t) c.function_offset + 1);
 
-		if (strings.size() <= h.function_count)
+		if (strings.size() <= c.function_count)
 			return false;
 
-		if (is.read(&strings[0], h.function_offset).gcount() != h.function_offset)
+		if (is.read(&strings[0], c.function_offset).gcount() != (std::streamsize) c.function_offset)
 			return false;
 
-		strings[h.function_offset] = 0;
+		strings[c.function_offset] = 0;
 
 		reader::profile builder(out.m_profile);
-		for (u32 i = 0; i < h.function_count; ++i)
+		for (u64 i = 0; i < c.function_count; ++i)
 		{
 			file::function fun;
 			if (!read(is, fun))
@@ -62,13 +419,86 @@ namespace profile { namespace io { namespace binary {
 				return false;
 		}
 
-		for (u32 i = 0; i < h.call_count; ++i)
+		// built after the blocks, one of which may hold their self times
+		std::vector<call_record> calls((size_t) c.call_count);
+		std::vector<u64> self;
+		if (h.version == file::VERSION_1)
 		{
-			file::call c;
-			if (!read(is, c))
-				return false;
+			for (auto& call : calls)
+			{
+				file::call old;
+				if (!read(is, old))
+					return false;
+				call = call_record::of(old);
+			}
+		}
+		else
+		{
+			// in as many blocks as the writer split them into, packed or not
+			self.resize(calls.size());
+			std::vector<std::vector<unsigned char>> raw, data;
+			std::vector<u32> tags;
+			size_t window = unpack_window();
+			size_t i = 0;
+			do
+			{
+				// the blocks of calls up to the window, and the header of
+				// the block after them left for read_blocks
+				u64 limit = (calls.size() - i) * call_encoder::LONGEST;
+				size_t count = 0;
+				while (count < window)
+				{
+					auto at = is.tellg();
+					file::block b;
+					if (!read(is, b) || (b.tag != file::BLOCK_CALLS && b.tag != file::BLOCK_PACKED))
+					{
+						if (!count)
+							return false;
+						is.clear();
+						is.seekg(at);
+						break;
+					}
+
+					if (b.size > limit + sizeof(file::packed))
+						return false;
+
+					if (count == raw.size())
+					{
+						raw.emplace_back();
+						data.emplace_back();
+						tags.push_back(0);
+					}
+
+					tags[count] = b.tag;
+					raw[count].resize(b.size);
+					if (!raw[count].empty() && is.read((char*) &raw[count][0], b.size).gcount() != b.size)
+						return false;
+					++count;
+				}
 
-			if (!builder.call(c.id, c.parent, c.function, c.flags, c.duration, flags))
+				if (!unpack(raw, tags, count, limit, data))
+					return false;
+
+				for (size_t block = 0; block < count; ++block)
+				{
+					auto& payload = tags[block] == file::BLOCK_PACKED ? data[block] : raw[block];
+					call_decoder decoder(payload.data(), payload.data() + payload.size());
+					for (; !decoder.done(); ++i)
+					{
+						if (i == calls.size() || !decoder.decode(calls[i], self[i]))
+							return false;
+					}
+				}
+			} while (i < calls.size());
+		}
+
+		if (!read_blocks(is, ~0ull, h.version == file::VERSION_WIDE, strings, builder, calls.size(), self))
+			return false;
+
+		for (size_t i = 0; i < calls.size(); ++i)
+		{
+			auto& call = calls[i];
+			if (!builder.call(call.id, call.parent, call.function, call.flags, call.duration, self.empty() ? file::NO_SELF : self[i], flags))
 				return false;
 		}
 
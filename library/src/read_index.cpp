@@ -0,0 +1,150 @@
+#ifdef FEATURE_IO_READ
+
+#include <profile/rotate.hpp>
+#include <cstring>
+#include <fstream>
+#include "expat.hpp"
+
+namespace profile { namespace io {
+
+	class IndexParser : public ::xml::ExpatBase<IndexParser>
+	{
+		segment_index& out;
+		bool ok;
+		bool inside;
+
+		template <typename T>
+		bool _atoUI(T& var, const char* c)
+		{
+			var = 0;
+			if (!*c)
+				return false;
+
+			for (; *c; ++c)
+			{
+				if (*c < '0' || *c > '9')
+					return false;
+				var = var * 10 + (*c - '0');
+			}
+			return true;
+		}
+
+		template <typename T>
+		void set(T& var, const XML_Char* attr) { ok = ok && _atoUI(var, attr); }
+		void set(long long& var, const XML_Char* attr)
+		{
+			bool negative = *attr == '-';
+			unsigned long long value;
+			ok = ok && _atoUI(value, attr + (negative ? 1 : 0));
+			var = negative ? -(long long) value : (long long) value;
+		}
+		void set(std::string& var, const XML_Char* attr) { var = attr; }
+
+	public:
+		IndexParser(segment_index& out): out(out), ok(true), inside(false) {}
+
+		void onStartElement(const XML_Char *name, const XML_Char **attrs)
+		{
+			if (!ok)
+				return;
+
+			if (!inside)
+			{
+				ok = !strcmp(name, "segments");
+				inside = true;
+				for (; ok && *attrs; attrs += 2)
+				{
+					if (!strcmp(attrs[0], "second"))
+						set(out.m_second, attrs[1]);
+				}
+
+				if (!out.m_second)
+					out.m_second = 1;
+				return;
+			}
+
+			if (strcmp(name, "segment"))
+			{
+				ok = false;
+				return;
+			}
+
+			segment s = {};
+			for (; ok && *attrs; attrs += 2)
+			{
+#define ATTR(field) if (!strcmp(attrs[0], #field)) set(s.field, attrs[1]); else
+				ATTR(sequence)
+				ATTR(file)
+				ATTR(from)
+				ATTR(to)
+				ATTR(began)
+				ATTR(ended)
+				ATTR(first)
+				ATTR(last)
+				{}
+#undef ATTR
+			}
+
+			ok = ok && !s.file.empty();
+			out.m_segments.push_back(s);
+		}
+
+		void onEndElement(const XML_Char*) {}
+
+		operator bool() const { return ok && inside; }
+	};
+
+	bool read_index(const char* path, segment_index& out)
+	{
+		std::ifstream is(path, std::ios::in | std::ios::binary);
+		if (!is)
+			return false;
+
+		IndexParser parser(out);
+		if (!parser.create(nullptr)) return false;
+		parser.enableElementHandler();
+
+		char buffer[8192];
+		std::streamsize read;
+		while ((read = is.read(buffer, sizeof(buffer)).gcount()) != 0)
+		{
+			if (!parser.parse(buffer, (int) read, false) || !parser)
+				return false;
+		}
+
+		return parser.parse(buffer, 0) && parser;
+	}
+
+	bool read_segments(const char* index, time::type from, time::type to, file_contents& out, unsigned int flags)
+	{
+		segment_index segments;
+		if (!read_index(index, segments))
+			return false;
+
+		// the segments lie next to the index
+		std::string dir(index);
+		auto slash = dir.find_last_of("/\\");
+		dir = slash == std::string::npos ? std::string() : dir.substr(0, slash + 1);
+
+		std::vector<std::string> files;
+		for (auto&& s : segments.m_segments)
+		{
+			if (s.to < from || s.from > to)
+				continue;
+
+			if (files.empty() || files.back() != s.file)
+				files.push_back(s.file);
+		}
+
+		for (auto&& file : files)
+		{
+			if (!read((dir + file).c_str(), out, flags))
+				return false;
+		}
+
+		return !files.empty();
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
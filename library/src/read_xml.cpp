@@ -2,6 +2,7 @@
 
 #include <profile/read.hpp>
 #include <iostream>
+#include <vector>
 #include "expat.hpp"
 #include "reader.hpp"
 
@@ -27,14 +28,26 @@ namespace profile { namespace io { namespace xml {
 			FUN_READ,
 			CALLS,
 			CALLS_READ,
+			ATTRIBUTES,
+			IO,
+			STALLS,
+			STALL,
+			AGGREGATES,
+			VIOLATIONS,
+			VIOLATION,
+			DOWNGRADES,
+			PROCESSES,
 			ALL_READ
 		};
 
 		Stage stage;
+		std::vector<collecting::stall> stalls;
+		std::vector<collecting::violation> violations;
 
 		template <typename T>
 		bool _atoUI(T& var, const char* c)
 		{
+			var = 0;
 			while(*c)
 			{
 				switch(*c)
@@ -103,6 +116,7 @@ namespace profile { namespace io { namespace xml {
 			function_id function = 0;
 			unsigned int flags = 0;
 			time::type duration = 0;
+			time::type self = collecting::call::NO_SELF;
 
 			FOR_EACH_ATTR()
 			{
@@ -111,6 +125,7 @@ namespace profile { namespace io { namespace xml {
 				ATTR(function)
 				ATTR(flags)
 				ATTR(duration)
+				ATTR(self)
 				{}
 			}
 
@@ -120,7 +135,228 @@ namespace profile { namespace io { namespace xml {
 				return;
 			}
 
-			ok = builder.call(id, parent, function, flags, duration, this->flags);
+			ok = builder.call(id, parent, function, flags, duration, self, this->flags);
+		}
+
+		void readAttribute(const XML_Char **attrs)
+		{
+			call_id call = 0;
+			std::string name;
+			std::string tag;
+			unsigned long long value = 0;
+			bool is_tag = false;
+
+			FOR_EACH_ATTR()
+			{
+				if (!strcmp(attrs[0], "tag"))
+					is_tag = true;
+
+				ATTR(call)
+				ATTR(name)
+				ATTR(tag)
+				ATTR(value)
+				{}
+			}
+
+			if (!call || name.empty())
+			{
+				ok = false;
+				return;
+			}
+
+			if (is_tag)
+				builder.attribute(call, name, tag);
+			else
+				builder.attribute(call, name, value);
+		}
+
+		void readIO(const XML_Char **attrs)
+		{
+			function_id function = 0;
+			unsigned int type = 0;
+			unsigned int fd = 0;
+			unsigned long long calls = 0;
+			unsigned long long bytes = 0;
+			time::type duration = 0;
+			std::string histogram;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(function)
+				ATTR(type)
+				ATTR(fd)
+				ATTR(calls)
+				ATTR(bytes)
+				ATTR(duration)
+				ATTR(histogram)
+				{}
+			}
+
+			unsigned long long buckets[collecting::io_stats::BUCKETS] = {};
+			size_t bucket = 0;
+			const char* c = histogram.c_str();
+			while (*c && bucket < collecting::io_stats::BUCKETS)
+			{
+				if (*c == ',')
+					++bucket;
+				else if (*c >= '0' && *c <= '9')
+					buckets[bucket] = buckets[bucket] * 10 + (*c - '0');
+				else
+					ok = false;
+				++c;
+			}
+
+			if (!function)
+				ok = false;
+
+			if (ok)
+				builder.io(function, type, fd, calls, bytes, duration, buckets);
+		}
+
+		void readStall(const XML_Char **attrs)
+		{
+			unsigned int thread = 0;
+			time::type observed = 0;
+			time::type open = 0;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(thread)
+				ATTR(observed)
+				ATTR(open)
+				{}
+			}
+
+			stalls.emplace_back(thread, observed, open);
+		}
+
+		void readFrame(const XML_Char **attrs)
+		{
+			call_id call = 0;
+			function_id function = 0;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(call)
+				ATTR(function)
+				{}
+			}
+
+			stalls.back().push(call, function);
+		}
+
+		void readAggregate(const XML_Char **attrs)
+		{
+			function_id function = 0;
+			collecting::aggregate a;
+			unsigned long long& calls = a.calls;
+			time::type& duration = a.duration;
+			time::type& self = a.self;
+			time::type& longest = a.longest;
+			unsigned long long& violations = a.violations;
+			unsigned long long& skipped = a.skipped;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(function)
+				ATTR(calls)
+				ATTR(duration)
+				ATTR(self)
+				ATTR(longest)
+				ATTR(violations)
+				ATTR(skipped)
+				{}
+			}
+
+			if (!function)
+				ok = false;
+
+			if (ok)
+				builder.aggregate(function, a);
+		}
+
+		void readDowngrade(const XML_Char **attrs)
+		{
+			function_id function = 0;
+			unsigned int recording = 0;
+			unsigned int rate = 0;
+			time::type at = 0;
+			unsigned long long hits = 0;
+			time::type window = 0;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(function)
+				ATTR(recording)
+				ATTR(rate)
+				ATTR(at)
+				ATTR(hits)
+				ATTR(window)
+				{}
+			}
+
+			if (!function)
+				ok = false;
+
+			if (ok)
+				builder.downgrade(collecting::downgrade(function, (ERecording) recording, rate, at, hits, window));
+		}
+
+		void readProcess(const XML_Char **attrs)
+		{
+			unsigned int pid = 0;
+			unsigned int parent = 0;
+			call_id first = 0;
+			call_id last = 0;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(pid)
+				ATTR(parent)
+				ATTR(first)
+				ATTR(last)
+				{}
+			}
+
+			if (ok)
+				builder.process(collecting::process(pid, parent, first, last));
+		}
+
+		void readViolation(const XML_Char **attrs)
+		{
+			call_id call = 0;
+			function_id function = 0;
+			time::type duration = 0;
+			time::type budget = 0;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(call)
+				ATTR(function)
+				ATTR(duration)
+				ATTR(budget)
+				{}
+			}
+
+			violations.emplace_back(call, function, duration, budget);
+		}
+
+		void readViolationFrame(const XML_Char *name, const XML_Char **attrs)
+		{
+			call_id call = 0;
+			function_id function = 0;
+
+			FOR_EACH_ATTR()
+			{
+				ATTR(call)
+				ATTR(function)
+				{}
+			}
+
+			if (!strcmp(name, "child"))
+				violations.back().child(call, function);
+			else
+				violations.back().push(call, function);
 		}
 
 	public:
@@ -166,6 +402,89 @@ namespace profile { namespace io { namespace xml {
 				readCall(attrs);
 				break;
 
+			case CALLS_READ:
+				if (!strcmp(name, "io"))
+				{
+					stage = IO;
+					break;
+				}
+				if (!strcmp(name, "stalls"))
+				{
+					stage = STALLS;
+					break;
+				}
+				if (!strcmp(name, "aggregates"))
+				{
+					stage = AGGREGATES;
+					break;
+				}
+				if (!strcmp(name, "violations"))
+				{
+					stage = VIOLATIONS;
+					break;
+				}
+				if (!strcmp(name, "downgrades"))
+				{
+					stage = DOWNGRADES;
+					break;
+				}
+				if (!strcmp(name, "processes"))
+				{
+					stage = PROCESSES;
+					break;
+				}
+				EXPECT("attributes");
+				stage = ATTRIBUTES;
+				break;
+
+			case IO:
+				EXPECT("op");
+				readIO(attrs);
+				break;
+
+			case STALLS:
+				EXPECT("stall");
+				stage = STALL;
+				readStall(attrs);
+				break;
+
+			case STALL:
+				EXPECT("frame");
+				readFrame(attrs);
+				break;
+
+			case ATTRIBUTES:
+				EXPECT("attr");
+				readAttribute(attrs);
+				break;
+
+			case AGGREGATES:
+				EXPECT("aggregate");
+				readAggregate(attrs);
+				break;
+
+			case DOWNGRADES:
+				EXPECT("downgrade");
+				readDowngrade(attrs);
+				break;
+
+			case PROCESSES:
+				EXPECT("process");
+				readProcess(attrs);
+				break;
+
+			case VIOLATIONS:
+				EXPECT("violation");
+				stage = VIOLATION;
+				readViolation(attrs);
+				break;
+
+			case VIOLATION:
+				if (strcmp(name, "child"))
+					EXPECT("frame");
+				readViolationFrame(name, attrs);
+				break;
+
 			default:
 				ok = false;
 			}
@@ -188,6 +507,61 @@ namespace profile { namespace io { namespace xml {
 				stage = CALLS_READ;
 				break;
 
+			case ATTRIBUTES:
+				EXPECT_BREAK("attr");
+				EXPECT("attributes");
+				stage = CALLS_READ;
+				break;
+
+			case IO:
+				EXPECT_BREAK("op");
+				EXPECT("io");
+				stage = CALLS_READ;
+				break;
+
+			case STALL:
+				EXPECT_BREAK("frame");
+				EXPECT("stall");
+				builder.stall(stalls.back());
+				stage = STALLS;
+				break;
+
+			case STALLS:
+				EXPECT("stalls");
+				stage = CALLS_READ;
+				break;
+
+			case AGGREGATES:
+				EXPECT_BREAK("aggregate");
+				EXPECT("aggregates");
+				stage = CALLS_READ;
+				break;
+
+			case VIOLATION:
+				EXPECT_BREAK("frame");
+				EXPECT_BREAK("child");
+				EXPECT("violation");
+				builder.violation(violations.back());
+				stage = VIOLATIONS;
+				break;
+
+			case VIOLATIONS:
+				EXPECT("violations");
+				stage = CALLS_READ;
+				break;
+
+			case DOWNGRADES:
+				EXPECT_BREAK("downgrade");
+				EXPECT("downgrades");
+				stage = CALLS_READ;
+				break;
+
+			case PROCESSES:
+				EXPECT_BREAK("process");
+				EXPECT("processes");
+				stage = CALLS_READ;
+				break;
+
 			case CALLS_READ:
 				EXPECT("stats");
 				stage = ALL_READ;
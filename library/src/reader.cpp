@@ -8,9 +8,9 @@ namespace profile { namespace io {
 
 	reader::section_t::section_t(collecting::section_type<std::string>& ref) : ref(ref) {}
 
-	void reader::section_t::call(call_id call, call_id parent, unsigned int flags, time::type duration)
+	void reader::section_t::call(call_id call, call_id parent, unsigned int flags, time::type duration, time::type self)
 	{
-		add_call(ref, call, parent, flags, duration);
+		add_call(ref, call, parent, flags, duration, self);
 	}
 
 	reader::function_t::function_t(collecting::function_type<std::string>& ref) : ref(ref) {}
@@ -43,11 +43,11 @@ namespace profile { namespace io {
 		return true;
 	}
 
-	bool reader::profile::call(call_id id, call_id parent, function_id function, unsigned int call_flags, time::type duration, unsigned int reader_flags)
+	bool reader::profile::call(call_id id, call_id parent, function_id function, unsigned int call_flags, time::type duration, time::type self, unsigned int reader_flags)
 	{
 		try
 		{
-			section(function).call(id, parent, call_flags, duration);
+			section(function).call(id, parent, call_flags, duration, self);
 		}
 		catch(reader::bad_section)
 		{
@@ -60,7 +60,7 @@ namespace profile { namespace io {
 			{
 				this->function(os.str())
 					.section(std::string(), function)
-					.call(id, parent, call_flags, duration);
+					.call(id, parent, call_flags, duration, self);
 			}
 			catch(reader::bad_section)
 			{
@@ -71,6 +71,52 @@ namespace profile { namespace io {
 		return true;
 	}
 
+	void reader::profile::attribute(call_id call, const std::string& name, unsigned long long value)
+	{
+		ref.attribute(call, name, value);
+	}
+
+	void reader::profile::attribute(call_id call, const std::string& name, const std::string& tag)
+	{
+		ref.attribute(call, name, tag);
+	}
+
+	void reader::profile::stall(const collecting::stall& s)
+	{
+		ref.add_stall(s);
+	}
+
+	void reader::profile::aggregate(function_id function, const collecting::aggregate& a)
+	{
+		try
+		{
+			section(function).ref.aggregate().merge(a);
+		}
+		catch(reader::bad_section)
+		{
+		}
+	}
+
+	void reader::profile::violation(const collecting::violation& v)
+	{
+		ref.add_violation(v);
+	}
+
+	void reader::profile::downgrade(const collecting::downgrade& d)
+	{
+		ref.add_downgrade(d);
+	}
+
+	void reader::profile::process(const collecting::process& p)
+	{
+		ref.add_process(p);
+	}
+
+	void reader::profile::io(function_id function, unsigned int op, unsigned int fd_class, unsigned long long calls, unsigned long long bytes, time::type duration, const unsigned long long* histogram)
+	{
+		ref.io(function, (EIoOp) op, (EFdClass) fd_class, calls, bytes, duration, histogram);
+	}
+
 }}
 
 #endif // FEATURE_IO_READ
@@ -19,9 +19,9 @@ namespace profile { namespace io {
 
 		static void add_call(
 				collecting::section_type<std::string>& section,
-				call_id call, call_id parent, unsigned int flags, time::type duration)
+				call_id call, call_id parent, unsigned int flags, time::type duration, time::type self)
 		{
-			section.add_call(call, parent, flags, duration);
+			section.add_call(call, parent, flags, duration, self);
 		}
 
 	public:
@@ -39,7 +39,7 @@ namespace profile { namespace io {
 			collecting::section_type<std::string>& ref;
 
 			section_t(collecting::section_type<std::string>& ref);
-			void call(call_id call, call_id parent, unsigned int flags, time::type duration);
+			void call(call_id call, call_id parent, unsigned int flags, time::type duration, time::type self);
 		};
 
 		struct function_t
@@ -59,7 +59,15 @@ namespace profile { namespace io {
 		public:
 			profile(collecting::profile_type<std::string>& ref);
 			bool function(function_id id, const std::string &name, const std::string &suffix, unsigned int reader_flags);
-			bool call(call_id id, call_id parent, function_id function, unsigned int call_flags, time::type duration, unsigned int reader_flags);
+			bool call(call_id id, call_id parent, function_id function, unsigned int call_flags, time::type duration, time::type self, unsigned int reader_flags);
+			void attribute(call_id call, const std::string& name, unsigned long long value);
+			void attribute(call_id call, const std::string& name, const std::string& tag);
+			void stall(const collecting::stall& s);
+			void aggregate(function_id function, const collecting::aggregate& a);
+			void violation(const collecting::violation& v);
+			void downgrade(const collecting::downgrade& d);
+			void process(const collecting::process& p);
+			void io(function_id function, unsigned int op, unsigned int fd_class, unsigned long long calls, unsigned long long bytes, time::type duration, const unsigned long long* histogram);
 		};
 	};
 
@@ -0,0 +1,186 @@
+#if defined(FEATURE_IO_WRITE) && defined(FEATURE_MT_ENABLED)
+
+#include "profile/rotate.hpp"
+#include "binary.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+namespace profile { namespace io {
+
+	namespace xml
+	{
+		void write(const collecting::profile_type<const char*>& profile, const char* filename);
+	}
+
+	namespace binary
+	{
+		unsigned long long write(const collecting::profile_type<const char*>& profile, const char* filename);
+		unsigned long long write_columns(const collecting::profile_type<const char*>& profile, const char* filename);
+	}
+
+	rotator::rotator(const char* basename, unsigned int interval_ms, size_t max_calls, EWriter typeId)
+		: rotator(collecting::session::current(), basename, interval_ms, max_calls, typeId)
+	{
+	}
+
+	rotator::rotator(collecting::session& session, const char* basename, unsigned int interval_ms, size_t max_calls, EWriter typeId)
+		: m_session(session)
+		, m_basename(basename)
+		, m_typeId(typeId)
+		, m_interval(interval_ms)
+		, m_max_calls(max_calls)
+		, m_stop(false)
+		, m_from(time::now())
+		, m_began((long long) std::time(nullptr))
+	{
+		if (m_typeId == EWriter_CHUNKED)
+			m_appender.reset(new binary::chunked::appender(m_basename + ".count"));
+
+		m_thread = std::thread([this] { run(); });
+	}
+
+	rotator::~rotator()
+	{
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		m_thread.join();
+
+		// the last segment is cut while the probes still open hold calls
+		// of their own, which they add to the session when they stop
+		rotate();
+	}
+
+	void rotator::run()
+	{
+		typedef std::chrono::steady_clock clock;
+
+		unsigned int poll = m_interval;
+		if (!poll || (m_max_calls && poll > POLL_INTERVAL))
+			poll = POLL_INTERVAL;
+
+		auto period = std::chrono::milliseconds(m_interval);
+		auto next = clock::now() + period;
+		std::unique_lock<std::mutex> lock(m_lock);
+		while (!m_wake.wait_for(lock, std::chrono::milliseconds(poll), [this] { return m_stop; }))
+		{
+			lock.unlock();
+
+			auto now = clock::now();
+			if ((m_interval && now >= next) || (m_max_calls && m_session.call_count() >= m_max_calls))
+			{
+				rotate();
+				next = now + period;
+			}
+
+			lock.lock();
+		}
+	}
+
+	void rotator::rotate()
+	{
+		std::lock_guard<std::mutex> guard(m_write);
+		(void)(guard);
+
+		auto profile = m_session.cut();
+
+		segment s = {};
+		s.sequence = (unsigned int) m_segments.size() + 1;
+		s.from = m_from;
+		s.to = m_from = time::now();
+		s.began = m_began;
+		s.ended = m_began = (long long) std::time(nullptr);
+
+		for (auto& f : profile) for (auto& sec : f) for (auto& c : sec)
+		{
+			if (!s.first || s.first > c.id())
+				s.first = c.id();
+			if (s.last < c.id())
+				s.last = c.id();
+		}
+
+		char sequence[20];
+		sprintf(sequence, ".%06u", s.sequence);
+		auto filename = m_basename + sequence;
+
+		switch (m_typeId)
+		{
+		case EWriter_XML: xml::write(profile, filename.c_str()); filename += ".xcount"; break;
+		case EWriter_BIN: binary::write(profile, filename.c_str()); filename += ".count"; break;
+		case EWriter_COLUMNS: binary::write_columns(profile, filename.c_str()); filename += ".ccount"; break;
+		case EWriter_CHUNKED: m_appender->append(profile); filename = m_basename + ".count"; break;
+		}
+
+		// the index lies next to the segments
+		auto slash = filename.find_last_of("/\\");
+		s.file = slash == std::string::npos ? filename : filename.substr(slash + 1);
+
+		m_segments.push_back(s);
+		index();
+	}
+
+	std::vector<rotator::segment> rotator::segments()
+	{
+		std::lock_guard<std::mutex> guard(m_write);
+		(void)(guard);
+
+		return m_segments;
+	}
+
+	// the names of the files come from the basename
+	static std::string escaped(const std::string& text)
+	{
+		std::string out;
+		for (auto c : text)
+		{
+			switch (c)
+			{
+			case '&': out += "&amp;"; break;
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '"': out += "&quot;"; break;
+			default: out += c;
+			}
+		}
+		return out;
+	}
+
+	// Written aside and renamed over the old one, so a reader sees either.
+	void rotator::index()
+	{
+		auto path = m_basename + ".index";
+		auto temp = path + ".tmp";
+		{
+			std::ofstream os(temp);
+			os << "<segments second=\"" << time::second() << "\">\n";
+			for (auto&& s : m_segments)
+			{
+				os << "\t<segment sequence=\"" << s.sequence << "\" file=\"" << escaped(s.file)
+				   << "\" from=\"" << s.from << "\" to=\"" << s.to
+				   << "\" began=\"" << s.began << "\" ended=\"" << s.ended << "\"";
+				if (s.first)
+					os << " first=\"" << s.first << "\" last=\"" << s.last << "\"";
+				os << " />\n";
+			}
+			os << "</segments>\n";
+
+			if (!os.flush())
+				return;
+		}
+
+		// on Windows, rename() does not replace a file
+		if (std::rename(temp.c_str(), path.c_str()))
+		{
+			std::remove(path.c_str());
+			std::rename(temp.c_str(), path.c_str());
+		}
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_WRITE && FEATURE_MT_ENABLED
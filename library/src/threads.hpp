@@ -0,0 +1,209 @@
+#ifndef __THREADS_HPP__
+#define __THREADS_HPP__
+
+#ifdef FEATURE_MT_ENABLED
+
+#include "profile/profile.hpp"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace profile { namespace mt {
+
+	struct open_probe
+	{
+		collecting::session* session;
+		call_id call;
+		function_id function;
+		time::type start;
+	};
+
+	// The probes currently open on a thread, readable from any other
+	// thread without locking. The owning thread is the only writer; the
+	// readers use the generation as a sequence lock and retry, whenever
+	// the stack changed under them.
+	class stack
+	{
+	public:
+		enum { DEPTH = 64 };
+
+	private:
+		struct entry
+		{
+			std::atomic<collecting::session*> session;
+			std::atomic<call_id> call;
+			std::atomic<function_id> function;
+			std::atomic<time::type> start;
+		};
+
+		std::atomic<unsigned int> m_generation;
+		std::atomic<unsigned int> m_depth;
+		entry m_entries[DEPTH];
+
+		void begin()
+		{
+			m_generation.store(m_generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+
+		void end()
+		{
+			m_generation.store(m_generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	public:
+		stack(): m_generation(0), m_depth(0) {}
+
+		void push(collecting::session* session, call_id call, function_id function, time::type start)
+		{
+			begin();
+			auto depth = m_depth.load(std::memory_order_relaxed);
+			if (depth < DEPTH)
+			{
+				auto& e = m_entries[depth];
+				e.session.store(session, std::memory_order_relaxed);
+				e.call.store(call, std::memory_order_relaxed);
+				e.function.store(function, std::memory_order_relaxed);
+				e.start.store(start, std::memory_order_relaxed);
+			}
+			m_depth.store(depth + 1, std::memory_order_relaxed);
+			end();
+		}
+
+		void pop()
+		{
+			begin();
+			m_depth.store(m_depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+			end();
+		}
+
+		// outermost probe first; probes nested deeper than DEPTH are not seen
+		bool snapshot(std::vector<open_probe>& out) const
+		{
+			for (int attempt = 0; attempt < 16; ++attempt)
+			{
+				auto before = m_generation.load(std::memory_order_acquire);
+				if (before & 1)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+
+				unsigned int depth = m_depth.load(std::memory_order_relaxed);
+				if (depth > DEPTH)
+					depth = DEPTH;
+
+				out.resize(depth);
+				for (unsigned int i = 0; i < depth; ++i)
+				{
+					out[i].session = m_entries[i].session.load(std::memory_order_relaxed);
+					out[i].call = m_entries[i].call.load(std::memory_order_relaxed);
+					out[i].function = m_entries[i].function.load(std::memory_order_relaxed);
+					out[i].start = m_entries[i].start.load(std::memory_order_relaxed);
+				}
+
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (m_generation.load(std::memory_order_relaxed) == before)
+					return true;
+			}
+
+			return false;
+		}
+	};
+
+	struct curr
+	{
+		collecting::probe* m_curr;
+		collecting::session* m_session;
+		std::thread::id m_id;
+		unsigned int m_index;
+		stack m_stack;
+		curr(unsigned int index): m_curr(nullptr), m_session(nullptr), m_id(std::this_thread::get_id()), m_index(index) {}
+
+		bool operator == (const std::thread::id& id) const { return m_id == id; }
+	};
+
+	class threads
+	{
+		std::list<curr> m_sinks;
+		spin_lock m_barrier;
+
+		static threads& inst()
+		{
+			static threads _;
+			return _;
+		}
+
+	public:
+		// The list is searched once for each thread; the entries never
+		// move, and the one of the forking thread stays in the child.
+		static curr& get()
+		{
+			static thread_local curr* cached = nullptr;
+			if (cached)
+				return *cached;
+
+			auto& i = inst();
+			std::lock_guard<spin_lock> guard(i.m_barrier);
+			(void)(guard); // "unused"
+
+			auto key = std::this_thread::get_id();
+			for (auto&& sink: i.m_sinks)
+			{
+				if (sink == key)
+					return *(cached = &sink);
+			}
+
+			i.m_sinks.emplace_back((unsigned int) i.m_sinks.size());
+			return *(cached = &i.m_sinks.back());
+		}
+
+		// held over fork(), see session::before_fork()
+		static void lock() { inst().m_barrier.lock(); }
+		static void unlock() { inst().m_barrier.unlock(); }
+
+		// in the child, with the lock taken: only the forking thread is left
+		static void forked()
+		{
+			auto key = std::this_thread::get_id();
+			inst().m_sinks.remove_if([&](const curr& sink) { return !(sink == key); });
+		}
+
+		// For the crash handler, which cannot wait for a thread that will
+		// never run again: goes on without the lock, when it is not free
+		// after a while.
+		template <typename F>
+		static void inspect(F f)
+		{
+			auto& i = inst();
+			bool locked = false;
+			for (int attempt = 0; !locked && attempt < 1000; ++attempt)
+				locked = i.m_barrier.try_lock();
+
+			for (auto&& sink: i.m_sinks)
+				f(sink);
+
+			if (locked)
+				i.m_barrier.unlock();
+		}
+
+		template <typename F>
+		static void for_each(F f)
+		{
+			auto& i = inst();
+			std::lock_guard<spin_lock> guard(i.m_barrier);
+			(void)(guard); // "unused"
+
+			for (auto&& sink: i.m_sinks)
+				f(sink);
+		}
+	};
+
+}} // profile::mt
+
+#endif // FEATURE_MT_ENABLED
+
+#endif // __THREADS_HPP__
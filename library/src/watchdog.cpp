@@ -0,0 +1,91 @@
+#if defined(FEATURE_IO_WRITE) && defined(FEATURE_MT_ENABLED)
+
+#include "profile/watchdog.hpp"
+#include "threads.hpp"
+
+#include <chrono>
+#include <utility>
+
+namespace profile { namespace mt {
+
+	watchdog::watchdog(unsigned int threshold_ms, unsigned int interval_ms)
+		: m_threshold(time::second() * threshold_ms / 1000)
+		, m_interval(interval_ms)
+		, m_stop(false)
+	{
+		m_thread = std::thread([this] { run(); });
+	}
+
+	watchdog::~watchdog()
+	{
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		m_thread.join();
+	}
+
+	void watchdog::run()
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		while (!m_wake.wait_for(lock, std::chrono::milliseconds(m_interval), [this] { return m_stop; }))
+		{
+			lock.unlock();
+			scan();
+			lock.lock();
+		}
+	}
+
+	void watchdog::scan()
+	{
+		auto now = time::now();
+		std::vector<std::pair<collecting::session*, collecting::stall>> found;
+		decltype(m_reported) still_open;
+		std::vector<open_probe> probes;
+
+		threads::for_each([&](curr& thread)
+		{
+			if (!thread.m_stack.snapshot(probes))
+				return;
+
+			for (auto&& p : probes)
+			{
+				if (m_reported.count({ p.session, p.call }))
+					still_open.insert({ p.session, p.call });
+			}
+
+			for (size_t i = probes.size(); i > 0; --i)
+			{
+				auto& p = probes[i - 1];
+				if (p.start > now || now - p.start < m_threshold)
+					continue;
+
+				if (m_reported.count({ p.session, p.call }))
+					break;
+
+				// the ids of the calls only mean something in their own session
+				collecting::stall s(thread.m_index, now, now - p.start);
+				for (size_t j = 0; j < i; ++j)
+				{
+					if (probes[j].session != p.session)
+						continue;
+					s.push(probes[j].call, probes[j].function);
+					still_open.insert({ p.session, probes[j].call });
+				}
+
+				found.emplace_back(p.session, s);
+				break;
+			}
+		});
+
+		// forget the calls which are already finished
+		m_reported.swap(still_open);
+
+		for (auto&& s : found)
+			s.first->add_stall(s.second);
+	}
+
+}} // profile::mt
+
+#endif // FEATURE_IO_WRITE && FEATURE_MT_ENABLED
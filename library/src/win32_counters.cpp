@@ -0,0 +1,17 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/counters.hpp"
+
+namespace profile { namespace counters {
+
+	// there is no perf_event_open() to read them with
+	ECounters start(ECounters) { return ECounters_OFF; }
+	void stop() {}
+	ECounters mode() { return ECounters_OFF; }
+	const char* name(unsigned int) { return nullptr; }
+	bool read(sample&) { return false; }
+
+}} // profile::counters
+
+#endif // FEATURE_IO_WRITE
@@ -0,0 +1,14 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/crash.hpp"
+
+namespace profile { namespace crash {
+
+	// not there yet; an unhandled exception filter would be the place
+	bool install(const char*, collecting::session&) { return false; }
+	void uninstall() {}
+
+}} // profile::crash
+
+#endif // FEATURE_IO_WRITE
@@ -0,0 +1,29 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <io.h>
+
+namespace profile { namespace collecting {
+
+	EFdClass io_probe::classify(int fd)
+	{
+		struct _stat st;
+		if (fd < 0 || _fstat(fd, &st))
+			return EFdClass_UNKNOWN;
+
+		if (st.st_mode & _S_IFREG)
+			return EFdClass_FILE;
+		if (st.st_mode & _S_IFIFO)
+			return EFdClass_PIPE;
+		if (st.st_mode & _S_IFCHR)
+			return _isatty(fd) ? EFdClass_TTY : EFdClass_DEVICE;
+
+		return EFdClass_UNKNOWN;
+	}
+
+}} // profile::collecting
+
+#endif // FEATURE_IO_WRITE
@@ -0,0 +1,56 @@
+#ifdef FEATURE_IO_READ
+
+#include "mapping.hpp"
+
+#include <windows.h>
+
+namespace profile { namespace io {
+
+	bool mapped_file::open(const char* path)
+	{
+		close();
+
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || !size.QuadPart)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		// the view keeps the mapping, the mapping keeps the file
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping)
+			return false;
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			CloseHandle(mapping);
+			return false;
+		}
+
+		m_data = (const char*) data;
+		m_size = (size_t) size.QuadPart;
+		m_handle = mapping;
+		return true;
+	}
+
+	void mapped_file::close()
+	{
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_handle)
+			CloseHandle(m_handle);
+		m_data = nullptr;
+		m_size = 0;
+		m_handle = nullptr;
+	}
+
+}} // profile::io
+
+#endif // FEATURE_IO_READ
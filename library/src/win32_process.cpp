@@ -0,0 +1,17 @@
+#ifdef FEATURE_IO_WRITE
+
+#include "profile/profile.hpp"
+#include "profile/process.hpp"
+
+#include <windows.h>
+
+namespace profile { namespace process {
+
+	unsigned int id() { return (unsigned int) GetCurrentProcessId(); }
+	unsigned int parent() { return 0; } // not needed without fork()
+	bool forked() { return false; }
+	bool watch_forks() { return false; }
+
+}} // profile::process
+
+#endif // FEATURE_IO_WRITE
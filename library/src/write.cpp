@@ -1,9 +1,19 @@
 #ifdef FEATURE_IO_WRITE
 
 #include "profile/profile.hpp"
+#include "profile/write.hpp"
+#include "profile/process.hpp"
+#include "job.hpp"
 
 #include <regex>
 
+#ifdef FEATURE_MT_ENABLED
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#endif // FEATURE_MT_ENABLED
+
 namespace profile { namespace io {
 
 	static void secs(time::type second, time::type ticks)
@@ -41,39 +51,79 @@ namespace profile { namespace io {
 		}
 	}
 
+	static bool contains(const std::string& name, const char* what)
+	{
+		return name.find(what) != std::string::npos;
+	}
+
+	// the patterns are compiled once, and tried only on the names
+	// which hold what they are looking for
 	std::string fold(std::string name)
 	{
+		static const std::regex keywords("(class )|(struct )|(enum )|(__thiscall )|(__cdecl )");
+		static const std::regex void_args("\\(void\\)");
+		static const std::regex basic_string("std::basic_string<([_a-zA-Z0-9]+),std::char_traits<\\1>,std::allocator<\\1> >");
+		static const std::regex string("std::basic_string<char>");
+		static const std::regex wstring("std::basic_string<wchar_t>");
+		static const std::regex vector("std::vector<([_a-zA-Z0-9:<>,]+),std::allocator<\\1> >");
+		static const std::regex set("std::set<([_a-zA-Z0-9:<>,]+),std::less<\\1 >,std::allocator<\\1 > >");
+		static const std::regex map("std::map<([_a-zA-Z0-9:<>,]+),([_a-zA-Z0-9:<>,]+),std::less<\\1 >,std::allocator<std::pair<\\1 const ,\\2 > > >");
+
 		//name = std::regex_replace(name, std::regex("unsigned char"), "uchar");
 		//name = std::regex_replace(name, std::regex("unsigned short"), "ushort");
 		//name = std::regex_replace(name, std::regex("unsigned int"), "uint");
 		//name = std::regex_replace(name, std::regex("unsigned long"), "ulong");
-		name = std::regex_replace(name, std::regex("(class )|(struct )|(enum )|(__thiscall )|(__cdecl )"), "");
-		name = std::regex_replace(name, std::regex("\\(void\\)"), "()");
-		name = std::regex_replace(name, std::regex("std::basic_string<([_a-zA-Z0-9]+),std::char_traits<\\1>,std::allocator<\\1> >"), "std::basic_string<$1>");
-		name = std::regex_replace(name, std::regex("std::basic_string<char>"), "std::string");
-		name = std::regex_replace(name, std::regex("std::basic_string<wchar_t>"), "std::wstring");
-		name = std::regex_replace(name, std::regex("std::vector<([_a-zA-Z0-9:<>,]+),std::allocator<\\1> >"), "std::vector<$1>");
-		name = std::regex_replace(name, std::regex("std::set<([_a-zA-Z0-9:<>,]+),std::less<\\1 >,std::allocator<\\1 > >"), "std::set<$1>");
-		name = std::regex_replace(name, std::regex("std::map<([_a-zA-Z0-9:<>,]+),([_a-zA-Z0-9:<>,]+),std::less<\\1 >,std::allocator<std::pair<\\1 const ,\\2 > > >"), "std::map<$1,$2>");
+		if (contains(name, "class ") || contains(name, "struct ") || contains(name, "enum ") || contains(name, "__thiscall ") || contains(name, "__cdecl "))
+			name = std::regex_replace(name, keywords, "");
+		if (contains(name, "(void)"))
+			name = std::regex_replace(name, void_args, "()");
+		if (contains(name, "std::basic_string<"))
+		{
+			name = std::regex_replace(name, basic_string, "std::basic_string<$1>");
+			name = std::regex_replace(name, string, "std::string");
+			name = std::regex_replace(name, wstring, "std::wstring");
+		}
+		if (contains(name, "std::vector<"))
+			name = std::regex_replace(name, vector, "std::vector<$1>");
+		if (contains(name, "std::set<"))
+			name = std::regex_replace(name, set, "std::set<$1>");
+		if (contains(name, "std::map<"))
+			name = std::regex_replace(name, map, "std::map<$1,$2>");
 		return name;
 	}
 
+	// each forked process writes a file of its own
+	static std::string output(const char* filename)
+	{
+		if (!process::forked())
+			return filename;
+
+		return std::string(filename) + "." + std::to_string(process::id());
+	}
+
 	namespace xml
 	{
-		void write(const char* filename);
+		void write(const collecting::session& session, const char* filename, write_job* job);
 	}
 
 	namespace binary
 	{
-		void write(const char* filename);
+		unsigned long long write(const collecting::session& session, const char* filename, write_job* job);
+		unsigned long long write_columns(const collecting::session& session, const char* filename, write_job* job);
+		unsigned long long write_chunked(const collecting::session& session, const char* filename, write_job* job);
 	}
 
 	void xml_write(const char* filename)
+	{
+		xml_write(collecting::session::current(), filename);
+	}
+
+	void xml_write(const collecting::session& session, const char* filename)
 	{
 		collecting::call self_probe(0, 0);
 		self_probe.start();
 
-		xml::write(filename);
+		xml::write(session, output(filename).c_str(), nullptr);
 
 		self_probe.stop();
 		printf("xml_write took ");
@@ -82,18 +132,175 @@ namespace profile { namespace io {
 	}
 
 	void binary_write(const char *filename)
+	{
+		binary_write(collecting::session::current(), filename);
+	}
+
+	void binary_write(const collecting::session& session, const char* filename)
 	{
 		collecting::call self_probe(0, 0);
 		self_probe.start();
 
-		binary::write(filename);
+		auto size = binary::write(session, output(filename).c_str(), nullptr);
 
 		self_probe.stop();
 		printf("binary_write took ");
 		secs(time::second(), self_probe.duration());
+		if (self_probe.duration())
+			printf(", %.1f MB/s", (double) size * time::second() / self_probe.duration() / (1024 * 1024));
+		printf("\n");
+	}
+
+	void columns_write(const char *filename)
+	{
+		columns_write(collecting::session::current(), filename);
+	}
+
+	void columns_write(const collecting::session& session, const char* filename)
+	{
+		collecting::call self_probe(0, 0);
+		self_probe.start();
+
+		auto size = binary::write_columns(session, output(filename).c_str(), nullptr);
+
+		self_probe.stop();
+		printf("columns_write took ");
+		secs(time::second(), self_probe.duration());
+		if (self_probe.duration())
+			printf(", %.1f MB/s", (double) size * time::second() / self_probe.duration() / (1024 * 1024));
 		printf("\n");
 	}
 
+	void chunked_write(const char *filename)
+	{
+		chunked_write(collecting::session::current(), filename);
+	}
+
+	void chunked_write(const collecting::session& session, const char* filename)
+	{
+		collecting::call self_probe(0, 0);
+		self_probe.start();
+
+		auto size = binary::write_chunked(session, output(filename).c_str(), nullptr);
+
+		self_probe.stop();
+		printf("chunked_write took ");
+		secs(time::second(), self_probe.duration());
+		if (self_probe.duration())
+			printf(", %.1f MB/s", (double) size * time::second() / self_probe.duration() / (1024 * 1024));
+		printf("\n");
+	}
+
+#ifdef FEATURE_MT_ENABLED
+	struct async_writer::impl: write_job
+	{
+		typedef std::chrono::steady_clock clock;
+
+		const collecting::session& session;
+		std::string filename;
+		EWriter typeId;
+		bool bounded;
+		clock::time_point deadline;
+		callback report;
+		std::atomic<bool> stopped;
+		std::mutex lock;
+		std::condition_variable done;
+		write_progress last;
+
+		impl(const collecting::session& session, const char* filename, EWriter typeId, unsigned int deadline_ms, callback progress)
+			: session(session)
+			, filename(output(filename))
+			, typeId(typeId)
+			, bounded(deadline_ms != 0)
+			, deadline(clock::now() + std::chrono::milliseconds(deadline_ms))
+			, report(progress)
+			, stopped(false)
+			, last()
+		{
+		}
+
+		bool expired()
+		{
+			return stopped || (bounded && clock::now() >= deadline);
+		}
+
+		void written(unsigned long long calls, unsigned long long total, unsigned long long bytes)
+		{
+			write_progress p = {};
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				(void)(guard);
+				last.calls = calls;
+				last.total = total;
+				last.bytes = bytes;
+				p = last;
+			}
+			if (report)
+				report(p);
+		}
+
+		void run()
+		{
+			switch (typeId)
+			{
+			case EWriter_XML: xml::write(session, filename.c_str(), this); break;
+			case EWriter_BIN: binary::write(session, filename.c_str(), this); break;
+			case EWriter_COLUMNS: binary::write_columns(session, filename.c_str(), this); break;
+			case EWriter_CHUNKED: binary::write_chunked(session, filename.c_str(), this); break;
+			}
+
+			write_progress p = {};
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				(void)(guard);
+				last.finished = true;
+				last.truncated = last.calls < last.total;
+				p = last;
+			}
+			done.notify_all();
+			if (report)
+				report(p);
+		}
+	};
+
+	async_writer::async_writer(const char* filename, EWriter typeId, unsigned int deadline_ms, callback progress)
+		: async_writer(collecting::session::current(), filename, typeId, deadline_ms, progress)
+	{
+	}
+
+	async_writer::async_writer(const collecting::session& session, const char* filename, EWriter typeId, unsigned int deadline_ms, callback progress)
+		: m_impl(new impl(session, filename, typeId, deadline_ms, progress))
+	{
+		auto job = m_impl.get();
+		m_thread = std::thread([job] { job->run(); });
+	}
+
+	async_writer::~async_writer()
+	{
+		m_thread.join();
+	}
+
+	bool async_writer::wait(unsigned int ms)
+	{
+		auto& job = *m_impl;
+		std::unique_lock<std::mutex> lock(job.lock);
+		return job.done.wait_for(lock, std::chrono::milliseconds(ms), [&] { return job.last.finished; });
+	}
+
+	void async_writer::stop()
+	{
+		m_impl->stopped = true;
+	}
+
+	write_progress async_writer::progress()
+	{
+		auto& job = *m_impl;
+		std::lock_guard<std::mutex> guard(job.lock);
+		(void)(guard);
+		return job.last;
+	}
+#endif // FEATURE_MT_ENABLED
+
 }} // profile::io
 
 #endif // FEATURE_IO_WRITE
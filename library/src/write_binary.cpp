@@ -1,10 +1,20 @@
 #ifdef FEATURE_IO_WRITE
 
 #include "profile/profile.hpp"
+#include "profile/process.hpp"
+#include "profile/codec.hpp"
 #include "binary.hpp"
 
-#include <regex>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <unordered_set>
+
+#ifdef FEATURE_MT_ENABLED
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif // FEATURE_MT_ENABLED
 
 namespace profile { namespace io {
     std::string fold(std::string name);
@@ -12,102 +22,925 @@ namespace profile { namespace io {
 
 namespace profile { namespace io { namespace binary {
 
-    struct string
+    // The strings of a profile come from a few places in the program,
+    // most of them many times over, so each pointer is interned once.
+    struct strings
     {
-        u32 offset;
-        std::string value;
+        string_table table;
+        std::unordered_map<const char*, u32> pointers;
+        std::unordered_map<const char*, u32> folded; // by the raw name
 
-        string(u32 offset, const std::string& value)
-            : offset(offset)
-            , value(value)
+        u32 add(const char* s)
         {
+            auto it = pointers.find(s);
+            if (it != pointers.end())
+                return it->second;
+
+            u32 ret = table.add(s);
+            pointers.emplace(s, ret);
+            return ret;
         }
-    };
 
+        u32 fold(const char* name)
+        {
+            auto it = folded.find(name);
+            if (it != folded.end())
+                return it->second;
 
-    struct strings
+            u32 ret = table.add(io::fold(name));
+            folded.emplace(name, ret);
+            return ret;
+        }
+    };
+
+    // Gathers the records in a large block and hands it to the stream
+    // whole, instead of one record at a time.
+    class output
     {
-        typedef std::vector<string> strings_t;
-        strings_t value;
-        u32 offset;
+        enum { BLOCK = 1 << 20 };
+
+        std::ofstream m_os;
+        std::vector<char> m_block;
+        size_t m_used;
+        u64 m_total;
 
-        strings()
-            : offset(0)
+    public:
+        output(const std::string& filename)
+            : m_os(filename, std::ios::out | std::ios::binary)
+            , m_block(BLOCK)
+            , m_used(0)
+            , m_total(0)
         {
-            add(std::string()); // "null" string
         }
 
-        u32 add(const std::string& s)
+        ~output() { flush(); }
+
+        void append(const void* data, size_t size)
         {
-            for (auto&& _s : value)
+            if (m_used + size > m_block.size())
             {
-                if (s == _s.value)
-                    return _s.offset;
+                flush();
+                if (size > m_block.size())
+                {
+                    m_os.write((const char*) data, size);
+                    m_total += size;
+                    return;
+                }
             }
 
-            u32 ret = offset;
-            value.emplace_back(offset, s);
-            offset += s.length() + 1;
+            memcpy(&m_block[m_used], data, size);
+            m_used += size;
+            m_total += size;
+        }
 
-            return ret;
+        template <typename T>
+        void put(const T& t) { append(&t, sizeof(t)); }
+
+        void flush()
+        {
+            if (m_used)
+                m_os.write(&m_block[0], m_used);
+            m_used = 0;
         }
-    };
 
-    void write(const char* filename)
-    {
-        auto profile = collecting::probe::profile();
+        // overwrites what was appended at the given offset before
+        void patch(u64 at, const void* data, size_t size)
+        {
+            flush();
+            m_os.seekp(at);
+            m_os.write((const char*) data, size);
+            m_os.seekp(0, std::ios::end);
+        }
 
-        std::ofstream os(std::string(filename) + ".count", std::ios::out | std::ios::binary);
+        template <typename T>
+        void patch(u64 at, const T& t) { patch(at, &t, sizeof(t)); }
 
-        file::header h = { file::VERSION }; // version
+        // pads with zeros up to a multiple of the alignment
+        void align(size_t alignment)
+        {
+            static const char zeros[8] = {};
+            if (m_total % alignment)
+                append(zeros, (size_t) (alignment - m_total % alignment));
+        }
+
+        u64 size() const { return m_total; }
+    };
 
+    // What both the rows and the columns have before the calls: the
+    // strings, the functions and the attributes naming their strings,
+    // narrowed by write_blocks, when the ids fit.
+    struct prologue
+    {
         strings str;
         std::vector<file::function> functions;
+        std::vector<file::wide::attribute> attributes;
+        u64 call_count;
 
+        prologue(const collecting::profile_type<const char*>& profile)
+            : call_count(0)
+        {
+            for (auto& f : profile)
+            {
+                for (auto& s : f)
+                {
+                    file::function fun = { s.id(), 0, 0 };
+                    fun.name = str.fold(f.nice());
+                    if (s.name() && *s.name())
+                        fun.suffix = str.add(s.name());
+                    functions.push_back(fun);
+
+                    call_count += s.size();
+                }
+            }
+
+            for (auto&& a : profile.attributes())
+                attributes.push_back(attribute(str, a));
+
+            str.table.pad();
+        }
+
+        static file::wide::attribute attribute(strings& str, const collecting::attribute_type<const char*>& a)
+        {
+            file::wide::attribute attr = { a.call(), str.add(a.name()), (u32) a.type(), 0, 0, a.value() };
+            if (a.isTag())
+                attr.tag = str.add(a.tag());
+            return attr;
+        }
+    };
+
+    // whether the ids, the counts or the offsets are past the ones of 2.0
+    static bool is_wide(const collecting::profile_type<const char*>& profile, u64 call_count, u64 call_offset)
+    {
+        return profile.last_call() > narrow_ids::LARGEST || call_count > narrow_ids::LARGEST || call_offset > narrow_ids::LARGEST;
+    }
+
+    // the payload of a chunk, see chunked::appender
+    class memory
+    {
+        std::vector<char> m_data;
+
+    public:
+        void append(const void* data, size_t size)
+        {
+            auto bytes = (const char*) data;
+            m_data.insert(m_data.end(), bytes, bytes + size);
+        }
+
+        template <typename T>
+        void put(const T& t) { append(&t, sizeof(t)); }
+
+        template <typename T>
+        void patch(size_t at, const T& t) { memcpy(&m_data[at], &t, sizeof(t)); }
+
+        void clear() { m_data.clear(); }
+        void swap(memory& rhs) { m_data.swap(rhs.m_data); }
+        const char* data() const { return m_data.data(); }
+        u64 size() const { return m_data.size(); }
+    };
+
+    // for file::write_header
+    template <typename T>
+    static void write(output& os, const T& t) { os.put(t); }
+
+    template <typename T>
+    static void write(memory& os, const T& t) { os.put(t); }
+
+    template <typename Ids, typename Output>
+    static void write_blocks(Output& os, const collecting::profile_type<const char*>& profile, const std::vector<file::wide::attribute>& attributes, const file::wide::process& proc);
+
+    template <typename Ids, typename Output>
+    static void write_process(Output& os, const file::wide::process& proc);
+
+    template <typename Output>
+    static void write_blocks(Output& os, bool wide, const collecting::profile_type<const char*>& profile, const std::vector<file::wide::attribute>& attributes, const file::wide::process& proc)
+    {
+        if (wide)
+            write_blocks<wide_ids>(os, profile, attributes, proc);
+        else
+            write_blocks<narrow_ids>(os, profile, attributes, proc);
+    }
+
+    // the only block left after the calls of a file stopped by its job
+    template <typename Output>
+    static void write_process(Output& os, bool wide, const file::wide::process& proc)
+    {
+        if (wide)
+            write_process<wide_ids>(os, proc);
+        else
+            write_process<narrow_ids>(os, proc);
+    }
+
+    // The calls going to one CALL block, as runs of the calls of the
+    // sections; a section too long for one block is cut between two.
+    // Each run starts at an iterator found by split(), as the compact
+    // calls can only be walked from the start of their section.
+    struct call_range
+    {
+        struct piece
+        {
+            collecting::section_type<const char*>::const_iterator from;
+            size_t count;
+        };
+
+        std::vector<piece> pieces;
+        size_t count;
+
+        call_range() : count(0) {}
+    };
+
+    static std::vector<call_range> split(const collecting::profile_type<const char*>& profile)
+    {
+        std::vector<call_range> ranges(1);
         for (auto& f : profile)
         {
             for (auto& s : f)
             {
-                file::function fun = { s.id(), 0, 0 };
-                fun.name = str.add(fold(f.nice()));
-                if (s.name() && *s.name())
-                    fun.suffix = str.add(s.name());
-                functions.push_back(fun);
+                size_t offset = 0;
+                auto from = s.begin();
+                while (offset < s.size())
+                {
+                    if (ranges.back().count == call_encoder::RANGE)
+                        ranges.emplace_back();
+
+                    auto& range = ranges.back();
+                    size_t count = s.size() - offset;
+                    if (count > call_encoder::RANGE - range.count)
+                        count = call_encoder::RANGE - range.count;
+
+                    call_range::piece p = { from, count };
+                    range.pieces.push_back(p);
+                    range.count += count;
+                    offset += count;
+
+                    // each section is walked once more, up to its last piece
+                    if (offset < s.size())
+                        std::advance(from, count);
+                }
+            }
+        }
+        return ranges;
+    }
+
+    // A CALL block of its own, with the encoder starting afresh. Returns
+    // the number of the calls encoded, fewer than in the range, when the
+    // job stopped it; it is asked every write_job::CALLS calls.
+    template <typename Output>
+    static size_t encode(Output& os, const call_range& range, file::wide::process& proc, write_job* job)
+    {
+        // the size of the block is known after the last call
+        auto at = os.size();
+        file::block calls = { file::BLOCK_CALLS, 0 };
+        os.put(calls);
+
+        call_encoder encoder;
+        unsigned char record[call_encoder::LONGEST];
+        size_t count = 0;
+        bool stopped = false;
+        for (auto& p : range.pieces)
+        {
+            auto c = p.from;
+            for (size_t i = 0; i < p.count; ++i, ++c, ++count)
+            {
+                if (job && !(count % write_job::CALLS) && job->expired())
+                {
+                    stopped = true;
+                    break;
+                }
+
+                if (!proc.first || proc.first > c->id())
+                    proc.first = c->id();
+                if (proc.last < c->id())
+                    proc.last = c->id();
+
+                call_record _c =
+                {
+                    c->id(),
+                    c->parent(),
+                    c->function(),
+                    c->flags(),
+                    c->duration()
+                };
+                os.append(record, encoder.encode(record, _c, c->hasSelf() ? c->self() : file::NO_SELF));
+            }
+
+            if (stopped)
+                break;
+        }
+
+        calls.size = (u32) (os.size() - at - sizeof(calls));
+        os.patch(at, calls);
+        return count;
+    }
+
+    // Replaces the CALL block with a PACK block, if the codec makes it
+    // any smaller.
+    static void pack(memory& block, const codec& packer)
+    {
+        std::vector<char> packed;
+        auto payload = block.data() + sizeof(file::block);
+        auto size = (size_t) block.size() - sizeof(file::block);
+        if (!packer.pack(payload, size, packed))
+            return;
+
+        memory out;
+        file::block b = { file::BLOCK_PACKED, (u32) (sizeof(file::packed) + packed.size()) };
+        file::packed p = { packer.id(), file::BLOCK_CALLS, (u32) size, 0 };
+        out.put(b);
+        out.put(p);
+        out.append(packed.data(), packed.size());
+        block.swap(out);
+    }
+
+#ifdef FEATURE_MT_ENABLED
+    // Encodes, and packs, the ranges on a thread for each core, each into
+    // a block of its own, while this thread writes the blocks finished so
+    // far, in order. No more than WINDOW blocks wait in the memory at a time.
+    // Returns the number of the calls written, before the job stopped it.
+    static u64 encode_parallel(output& os, const std::vector<call_range>& ranges, const codec* packer, file::wide::process& proc, u64 total, write_job* job)
+    {
+        size_t threads = std::thread::hardware_concurrency();
+        if (!threads)
+            threads = 2;
+        if (threads > ranges.size())
+            threads = ranges.size();
+        const size_t WINDOW = 2 * threads;
+
+        std::vector<memory> blocks(ranges.size());
+        std::vector<file::wide::process> procs(ranges.size());
+        std::vector<size_t> counts(ranges.size());
+        std::vector<char> ready(ranges.size());
+        std::mutex lock;
+        std::condition_variable changed;
+        size_t next = 0;
+        size_t written = 0;
+
+        auto worker = [&] {
+            for (;;)
+            {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] { return next == ranges.size() || next < written + WINDOW; });
+                    if (next == ranges.size())
+                        return;
+                    i = next++;
+                }
+
+                file::wide::process local = {};
+                auto count = encode(blocks[i], ranges[i], local, job);
+                if (packer && !(job && job->expired()))
+                    pack(blocks[i], *packer);
 
-                ++h.function_count;
-                for (auto&& c : s)
                 {
-                    c, ++h.call_count;
+                    std::lock_guard<std::mutex> guard(lock);
+                    (void)(guard);
+                    procs[i] = local;
+                    counts[i] = count;
+                    ready[i] = 1;
                 }
+                changed.notify_all();
             }
+        };
+
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < threads; ++t)
+            pool.emplace_back(worker);
+
+        // the workers finish the blocks they are in, and take no more
+        auto stop = [&] {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                (void)(guard);
+                next = ranges.size();
+            }
+            changed.notify_all();
+        };
+
+        u64 calls = 0;
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            if (job && job->expired())
+            {
+                // the reader expects a CALL block, even an empty one
+                if (!i)
+                    encode(os, call_range(), proc, nullptr);
+                stop();
+                break;
+            }
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] { return ready[i] != 0; });
+            }
+
+            os.append(blocks[i].data(), (size_t) blocks[i].size());
+            memory().swap(blocks[i]);
+
+            if (procs[i].first && (!proc.first || proc.first > procs[i].first))
+                proc.first = procs[i].first;
+            if (proc.last < procs[i].last)
+                proc.last = procs[i].last;
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                (void)(guard);
+                written = i + 1;
+            }
+            changed.notify_all();
+
+            calls += counts[i];
+            if (job)
+                job->written(calls, total, os.size());
+
+            if (counts[i] < ranges[i].count)
+            {
+                stop();
+                break;
+            }
+        }
+
+        for (auto& t : pool)
+            t.join();
+
+        return calls;
+    }
+#endif // FEATURE_MT_ENABLED
+
+    // one range after another, up to the call the job stopped it at
+    static u64 encode_serial(output& os, const std::vector<call_range>& ranges, const codec* packer, file::wide::process& proc, u64 total, write_job* job)
+    {
+        u64 calls = 0;
+        for (auto& range : ranges)
+        {
+            size_t count;
+            if (packer)
+            {
+                memory block;
+                count = encode(block, range, proc, job);
+
+                // past the deadline, the block is written as it is
+                if (!(job && job->expired()))
+                    pack(block, *packer);
+                os.append(block.data(), (size_t) block.size());
+            }
+            else
+                count = encode(os, range, proc, job);
+
+            calls += count;
+            if (job)
+                job->written(calls, total, os.size());
+
+            if (count < range.count)
+                break;
         }
+        return calls;
+    }
+
+    // Walks the profile in place: the functions once for the strings,
+    // the calls once for themselves, split into ranges encoded side by
+    // side, when there are many. Stopped by the job, the file ends with
+    // the calls written so far, counted by the header, and the process.
+    u64 write(const collecting::profile_type<const char*>& profile, const char* filename, write_job* job)
+    {
+        output os(std::string(filename) + ".count");
+
+        prologue pro(profile);
 
-        h.function_offset = ((str.offset + 3) >> 2) << 2;
-        h.call_offset = h.function_offset + functions.size() * sizeof(file::function);
-        h.second = time::second();
+        file::counts c;
+        c.function_count = pro.functions.size();
+        c.call_count = pro.call_count;
+        c.function_offset = pro.str.table.data.size();
+        c.call_offset = c.function_offset + c.function_count * sizeof(file::function);
+        auto wide = is_wide(profile, c.call_count, c.call_offset);
+        auto version = wide ? file::VERSION_WIDE : file::VERSION;
 
-        write(os, file::MAGIC);
-        write(os, h);
+        os.put(file::MAGIC);
+        file::write_header(os, version, c, time::second());
 
-        for (auto& s : str.value)
-            os.write(s.value.c_str(), s.value.length() + 1);
-        os.write("\xFF\xFF\xFF\xFF", h.function_offset - str.offset); // pad, if needed
+        os.append(&pro.str.table.data[0], pro.str.table.data.size());
 
-        for (auto& f: functions)
-            write(os, f);
+        if (!pro.functions.empty())
+            os.append(&pro.functions[0], pro.functions.size() * sizeof(file::function));
 
+        file::wide::process proc = { process::id(), process::parent(), 0, 0 };
+        auto ranges = split(profile);
+        auto packer = binary_codec();
+        u64 written;
+#ifdef FEATURE_MT_ENABLED
+        if (ranges.size() > 1)
+            written = encode_parallel(os, ranges, packer, proc, pro.call_count, job);
+        else
+#endif // FEATURE_MT_ENABLED
+            written = encode_serial(os, ranges, packer, proc, pro.call_count, job);
+
+        if (written < pro.call_count)
+        {
+            c.call_count = written;
+
+            memory head;
+            file::write_header(head, version, c, time::second());
+            os.patch(sizeof(file::MAGIC), head.data(), (size_t) head.size());
+
+            write_process(os, wide, proc);
+        }
+        else
+            write_blocks(os, wide, profile, pro.attributes, proc);
+
+        os.flush();
+        if (job)
+            job->written(c.call_count, pro.call_count, os.size());
+        return os.size();
+    }
+
+    u64 write(const collecting::profile_type<const char*>& profile, const char* filename)
+    {
+        return write(profile, filename, nullptr);
+    }
+
+    static void put_id(output& os, bool wide, call_id id)
+    {
+        if (wide)
+            os.put<u64>(id);
+        else
+            os.put<u32>((u32) id);
+    }
+
+    // Walks the calls once for each column. Each column needs all of
+    // the calls, so the job is told of the file only when it is whole.
+    u64 write_columns(const collecting::profile_type<const char*>& profile, const char* filename, write_job* job)
+    {
+        output os(std::string(filename) + ".ccount");
+
+        prologue pro(profile);
+        auto wide = is_wide(profile, pro.call_count, 0);
+        std::vector<columnar::section> sections;
+        auto section = [&](u32 tag, u64 offset) {
+            columnar::section sec = { tag, 0, offset, os.size() - offset };
+            sections.push_back(sec);
+            os.align(8);
+        };
+
+        os.put(columnar::MAGIC);
+
+        u64 at = os.size();
+        os.append(&pro.str.table.data[0], pro.str.table.data.size());
+        section(columnar::SECTION_STRINGS, at);
+
+        at = os.size();
+        if (!pro.functions.empty())
+            os.append(&pro.functions[0], pro.functions.size() * sizeof(file::function));
+        section(columnar::SECTION_FUNCTIONS, at);
+
+        file::wide::process proc = { process::id(), process::parent(), 0, 0 };
+        at = os.size();
+        for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+        {
+            if (!proc.first || proc.first > c.id())
+                proc.first = c.id();
+            if (proc.last < c.id())
+                proc.last = c.id();
+            put_id(os, wide, c.id());
+        }
+        section(columnar::SECTION_IDS, at);
+
+        at = os.size();
+        for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            put_id(os, wide, c.parent());
+        section(columnar::SECTION_PARENTS, at);
+
+        at = os.size();
+        for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            os.put<u32>(c.function());
+        section(columnar::SECTION_CALLED, at);
+
+        at = os.size();
+        for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            os.put<u32>(c.flags());
+        section(columnar::SECTION_FLAGS, at);
+
+        at = os.size();
+        for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            os.put<u64>(c.duration());
+        section(columnar::SECTION_DURATIONS, at);
+
+        at = os.size();
         for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            os.put<u64>(c.hasSelf() ? c.self() : file::NO_SELF);
+        section(columnar::SECTION_SELF, at);
+
+        at = os.size();
+        write_blocks(os, wide, profile, pro.attributes, proc);
+        section(columnar::SECTION_BLOCKS, at);
+
+        os.append(&sections[0], sections.size() * sizeof(columnar::section));
+
+        columnar::footer foot = { wide ? columnar::VERSION_WIDE : columnar::VERSION, (u32) sections.size(), pro.call_count, pro.functions.size(), time::second(), columnar::MAGIC };
+        os.put(foot);
+
+        os.flush();
+        if (job)
+            job->written(pro.call_count, pro.call_count, os.size());
+        return os.size();
+    }
+
+    u64 write_columns(const collecting::profile_type<const char*>& profile, const char* filename)
+    {
+        return write_columns(profile, filename, nullptr);
+    }
+
+    // The blocks following the calls, up to the end of the file, with
+    // the call ids as wide as Ids lays them out.
+    template <typename Ids, typename Output>
+    static void write_blocks(Output& os, const collecting::profile_type<const char*>& profile, const std::vector<file::wide::attribute>& attributes, const file::wide::process& proc)
+    {
+        typedef typename Ids::attribute attribute;
+        typedef typename Ids::frame frame;
+        typedef typename Ids::violation violation;
+
+        if (!attributes.empty())
+        {
+            file::block b = { file::BLOCK_ATTRIBUTES, (u32) (attributes.size() * sizeof(attribute)) };
+            os.put(b);
+            for (auto& a : attributes)
+                os.put(attribute_as<attribute>(a));
+        }
+
+        if (!profile.io().empty())
+        {
+            std::vector<file::io_stats> io;
+            for (auto&& i : profile.io())
+            {
+                file::io_stats stats = { i.function(), (u32) i.op(), (u32) i.fdClass(), 0, i.calls(), i.bytes(), i.duration() };
+                for (int b = 0; b < collecting::io_stats::BUCKETS; ++b)
+                    stats.histogram[b] = i.histogram()[b];
+                io.push_back(stats);
+            }
+
+            file::block b = { file::BLOCK_IO, (u32) (io.size() * sizeof(file::io_stats)) };
+            os.put(b);
+            os.append(&io[0], io.size() * sizeof(file::io_stats));
+        }
+
+        if (!profile.stalls().empty())
+        {
+            u32 size = 0;
+            for (auto&& st : profile.stalls())
+                size += sizeof(file::stall) + st.stack().size() * sizeof(frame);
+
+            file::block b = { file::BLOCK_STALLS, size };
+            os.put(b);
+            for (auto&& st : profile.stalls())
+            {
+                file::stall _st = { st.thread(), (u32) st.stack().size(), st.observed(), st.open() };
+                os.put(_st);
+                for (auto&& f : st.stack())
+                    os.put(frame_as<frame>(f));
+            }
+        }
+
+        std::vector<file::aggregate> aggregates;
+        for (auto& f : profile) for (auto& s : f)
+        {
+            auto& a = s.aggregate();
+            if (a.empty())
+                continue;
+
+            file::aggregate _a = { s.id(), 0, a.calls, a.duration, a.self, a.longest, a.violations, a.skipped };
+            aggregates.push_back(_a);
+        }
+
+        if (!aggregates.empty())
+        {
+            file::block b = { file::BLOCK_AGGREGATES, (u32) (aggregates.size() * sizeof(file::aggregate)) };
+            os.put(b);
+            os.append(&aggregates[0], aggregates.size() * sizeof(file::aggregate));
+        }
+
+        if (!profile.violations().empty())
+        {
+            u32 size = 0;
+            for (auto&& v : profile.violations())
+                size += sizeof(violation) + (v.stack().size() + v.children().size()) * sizeof(frame);
+
+            file::block b = { file::BLOCK_VIOLATIONS, size };
+            os.put(b);
+            for (auto&& v : profile.violations())
+            {
+                violation _v = {};
+                _v.call = (decltype(_v.call)) v.call();
+                _v.function = v.function();
+                _v.depth = (u32) v.stack().size();
+                _v.children = (u32) v.children().size();
+                _v.duration = v.duration();
+                _v.budget = v.budget();
+                os.put(_v);
+                for (auto&& f : v.stack())
+                    os.put(frame_as<frame>(f));
+                for (auto&& f : v.children())
+                    os.put(frame_as<frame>(f));
+            }
+        }
+
+        if (!profile.downgrades().empty())
+        {
+            std::vector<file::downgrade> downgrades;
+            for (auto&& d : profile.downgrades())
+            {
+                file::downgrade _d = { d.function(), (u32) d.recording(), d.rate(), 0, d.at(), d.hits(), d.window() };
+                downgrades.push_back(_d);
+            }
+
+            file::block b = { file::BLOCK_DOWNGRADES, (u32) (downgrades.size() * sizeof(file::downgrade)) };
+            os.put(b);
+            os.append(&downgrades[0], downgrades.size() * sizeof(file::downgrade));
+        }
+
+        write_process<Ids>(os, proc);
+    }
+
+    template <typename Ids, typename Output>
+    static void write_process(Output& os, const file::wide::process& proc)
+    {
+        file::block b = { file::BLOCK_PROCESSES, sizeof(typename Ids::process) };
+        os.put(b);
+        os.put(process_as<typename Ids::process>(proc));
+    }
+
+    // lent by the session, which the probes of the other threads go on adding to
+    u64 write(const collecting::session& session, const char* filename, write_job* job)
+    {
+        u64 size = 0;
+        session.lend([&](const collecting::profile_type<const char*>& profile) { size = write(profile, filename, job); });
+        return size;
+    }
+
+    u64 write_columns(const collecting::session& session, const char* filename, write_job* job)
+    {
+        u64 size = 0;
+        session.lend([&](const collecting::profile_type<const char*>& profile) { size = write_columns(profile, filename, job); });
+        return size;
+    }
+
+    struct chunked::appender::impl
+    {
+        output os;
+        strings str;
+        u32 strings_written;
+        std::unordered_set<u32> functions; // the ids written
+        memory payload;
+
+        impl(const std::string& path)
+            : os(path)
+            , strings_written(0)
+        {
+            file::header h = { file::VERSION_CHUNKED };
+            h.second = time::second();
+            os.put(file::MAGIC);
+            os.put(h);
+            os.flush();
+        }
+
+        void chunk(u32 tag)
+        {
+            chunked::chunk c = { tag, (u32) payload.size(), 0, 0 };
+            c.crc = chunked::crc(c, payload.data());
+            os.put(c);
+            os.append(payload.data(), (size_t) payload.size());
+            payload.clear();
+        }
+    };
+
+    chunked::appender::appender(const std::string& path)
+        : m_impl(new impl(path))
+    {
+    }
+
+    chunked::appender::~appender()
+    {
+    }
+
+    // The chunks of one profile go to the file whole, before it returns.
+    // Stopped by the job, the calls end with the last CALL chunk written,
+    // followed by a chunk of blocks holding only the process.
+    u64 chunked::appender::append(const collecting::profile_type<const char*>& profile, write_job* job)
+    {
+        auto& self = *m_impl;
+        auto& payload = self.payload;
+
+        // the names may be gone by the next profile, the strings stay
+        self.str.pointers.clear();
+        self.str.folded.clear();
+
+        std::vector<file::function> functions;
+        for (auto& f : profile)
         {
-            file::call _c =
+            for (auto& s : f)
             {
-                c.id(),
-                c.parent(),
-                c.function(),
-                c.flags(),
-                c.duration()
-            };
-            write(os, _c);
+                if (!self.functions.insert(s.id()).second)
+                    continue;
+
+                file::function fun = { s.id(), 0, 0 };
+                fun.name = self.str.fold(f.nice());
+                if (s.name() && *s.name())
+                    fun.suffix = self.str.add(s.name());
+                functions.push_back(fun);
+            }
+        }
+
+        std::vector<file::wide::attribute> attributes;
+        for (auto&& a : profile.attributes())
+            attributes.push_back(prologue::attribute(self.str, a));
+
+        auto& table = self.str.table.data;
+        if (table.size() > self.strings_written)
+        {
+            payload.put(self.strings_written);
+            payload.append(&table[self.strings_written], table.size() - self.strings_written);
+            self.chunk(chunked::CHUNK_STRINGS);
+            self.strings_written = (u32) table.size();
+        }
+
+        if (!functions.empty())
+        {
+            payload.append(&functions[0], functions.size() * sizeof(file::function));
+            self.chunk(chunked::CHUNK_FUNCTIONS);
         }
+
+        u64 total = 0;
+        if (job)
+        {
+            for (auto& f : profile) for (auto& s : f)
+                total += s.size();
+        }
+
+        file::wide::process proc = { process::id(), process::parent(), 0, 0 };
+        u64 written = 0;
+
+        // false, when the job stopped it between two chunks
+        auto calls = [&]() -> bool {
+            call_encoder encoder;
+            unsigned char record[call_encoder::LONGEST];
+            u32 count = 0;
+            for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            {
+                if (!count && job && job->expired())
+                    return false;
+
+                if (!proc.first || proc.first > c.id())
+                    proc.first = c.id();
+                if (proc.last < c.id())
+                    proc.last = c.id();
+
+                if (!count)
+                    payload.put(count); // patched below
+
+                call_record _c = { c.id(), c.parent(), c.function(), c.flags(), c.duration() };
+                payload.append(record, encoder.encode(record, _c, c.hasSelf() ? c.self() : file::NO_SELF));
+
+                if (++count == chunked::CALLS)
+                {
+                    payload.patch(0, count);
+                    self.chunk(chunked::CHUNK_CALLS);
+                    encoder = call_encoder();
+                    written += count;
+                    count = 0;
+
+                    if (job)
+                        job->written(written, total, self.os.size());
+                }
+            }
+
+            if (count)
+            {
+                payload.patch(0, count);
+                self.chunk(chunked::CHUNK_CALLS);
+                written += count;
+            }
+            return true;
+        };
+
+        // the ids of a long running process outgrow 2.0 in one of the later profiles
+        auto wide = is_wide(profile, 0, 0);
+        if (calls())
+            write_blocks(payload, wide, profile, attributes, proc);
+        else
+            write_process(payload, wide, proc);
+        self.chunk(wide ? chunked::CHUNK_WIDE_BLOCKS : chunked::CHUNK_BLOCKS);
+
+        self.os.flush();
+        if (job)
+            job->written(written, total, self.os.size());
+        return self.os.size();
+    }
+
+    u64 write_chunked(const collecting::session& session, const char* filename, write_job* job)
+    {
+        u64 size = 0;
+        session.lend([&](const collecting::profile_type<const char*>& profile) {
+            chunked::appender out(std::string(filename) + ".count");
+            size = out.append(profile, job);
+        });
+        return size;
     }
 
 }}} // profile::io::binary
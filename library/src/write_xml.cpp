@@ -1,9 +1,12 @@
 #ifdef FEATURE_IO_WRITE
 
 #include "profile/profile.hpp"
+#include "profile/process.hpp"
+#include "job.hpp"
 
-#include <regex>
+#include <cstring>
 #include <fstream>
+#include <unordered_map>
 
 namespace profile { namespace io {
     std::string fold(std::string name);
@@ -11,25 +14,222 @@ namespace profile { namespace io {
 
 namespace profile { namespace io { namespace xml {
 
-    static std::string xml(std::string attr)
+    struct escaped
     {
-        attr = std::regex_replace(attr, std::regex("&"), "&amp;");
-        attr = std::regex_replace(attr, std::regex("<"), "&lt;");
-        attr = std::regex_replace(attr, std::regex(">"), "&gt;");
-        return std::regex_replace(attr, std::regex("\""), "&quot;");
-    }
+        const char* text;
+        size_t length;
+        explicit escaped(const char* text) : text(text), length(strlen(text)) {}
+        explicit escaped(const std::string& text) : text(text.c_str()), length(text.length()) {}
+    };
 
-    void write(const char* filename)
+    // Formats the document in a large block and hands it to the stream
+    // whole. Numbers are printed by hand and the attributes are escaped
+    // in one pass, copied as they are, if there is nothing to escape.
+    class output
     {
-        auto profile = collecting::probe::profile();
+        enum { BLOCK = 1 << 20 };
+
+        std::ofstream m_os;
+        std::vector<char> m_block;
+        size_t m_used;
+        unsigned long long m_total;
+
+        void append(const char* data, size_t size)
+        {
+            m_total += size;
+            if (m_used + size > m_block.size())
+            {
+                flush();
+                if (size > m_block.size())
+                {
+                    m_os.write(data, size);
+                    return;
+                }
+            }
+
+            memcpy(&m_block[m_used], data, size);
+            m_used += size;
+        }
+
+    public:
+        output(const std::string& filename)
+            : m_os(filename)
+            , m_block(BLOCK)
+            , m_used(0)
+            , m_total(0)
+        {
+        }
+
+        ~output() { flush(); }
+
+        void flush()
+        {
+            if (m_used)
+                m_os.write(&m_block[0], m_used);
+            m_used = 0;
+        }
+
+        unsigned long long size() const { return m_total; }
+
+        output& operator<<(const char* s) { append(s, strlen(s)); return *this; }
+        output& operator<<(const std::string& s) { append(s.c_str(), s.length()); return *this; }
+
+        output& operator<<(unsigned long long value)
+        {
+            char buffer[20];
+            char* ptr = buffer + sizeof(buffer);
+            do
+            {
+                *--ptr = (char) ('0' + value % 10);
+                value /= 10;
+            } while (value);
+            append(ptr, buffer + sizeof(buffer) - ptr);
+            return *this;
+        }
+
+        output& operator<<(unsigned int value) { return *this << (unsigned long long) value; }
+
+        output& operator<<(int value) // the enums
+        {
+            if (value < 0)
+                return *this << "-" << (0ull - (unsigned long long) value);
+            return *this << (unsigned long long) value;
+        }
+
+        output& operator<<(const escaped& attr)
+        {
+            const char* ptr = attr.text;
+            const char* end = ptr + attr.length;
+            const char* from = ptr;
+            for (; ptr != end; ++ptr)
+            {
+                const char* entity;
+                switch (*ptr)
+                {
+                case '&': entity = "&amp;"; break;
+                case '<': entity = "&lt;"; break;
+                case '>': entity = "&gt;"; break;
+                case '"': entity = "&quot;"; break;
+                default: continue;
+                }
+                append(from, ptr - from);
+                *this << entity;
+                from = ptr + 1;
+            }
+            append(from, end - from);
+            return *this;
+        }
+    };
+
+    // the sections between the calls and the processes
+    static void write_sections(output& os, const collecting::profile_type<const char*>& profile)
+    {
+        if (!profile.attributes().empty())
+        {
+            os << "\t<attributes>\n";
+            for (auto&& a : profile.attributes())
+            {
+                os << "\t\t<attr call=\"" << a.call() << "\" name=\"" << escaped(a.name()) << "\"";
+                if (a.isTag())
+                    os << " tag=\"" << escaped(a.tag()) << "\"";
+                else
+                    os << " value=\"" << a.value() << "\"";
+                os << " />\n";
+            }
+            os << "\t</attributes>\n";
+        }
+
+        if (!profile.io().empty())
+        {
+            os << "\t<io>\n";
+            for (auto&& i : profile.io())
+            {
+                os << "\t\t<op function=\"" << i.function() << "\" type=\"" << i.op() << "\" fd=\"" << i.fdClass()
+                   << "\" calls=\"" << i.calls() << "\" bytes=\"" << i.bytes() << "\" duration=\"" << i.duration() << "\" histogram=\"";
+                for (int b = 0; b < collecting::io_stats::BUCKETS; ++b)
+                    os << (b ? "," : "") << i.histogram()[b];
+                os << "\" />\n";
+            }
+            os << "\t</io>\n";
+        }
 
-        std::ofstream os(std::string(filename) + ".xcount");
+        if (!profile.stalls().empty())
+        {
+            os << "\t<stalls>\n";
+            for (auto&& st : profile.stalls())
+            {
+                os << "\t\t<stall thread=\"" << st.thread() << "\" observed=\"" << st.observed() << "\" open=\"" << st.open() << "\">\n";
+                for (auto&& f : st.stack())
+                    os << "\t\t\t<frame call=\"" << f.call << "\" function=\"" << f.function << "\" />\n";
+                os << "\t\t</stall>\n";
+            }
+            os << "\t</stalls>\n";
+        }
+
+        bool aggregates = false;
+        for (auto& f : profile) for (auto& s : f)
+        {
+            auto& a = s.aggregate();
+            if (a.empty())
+                continue;
+
+            if (!aggregates)
+                os << "\t<aggregates>\n";
+            aggregates = true;
+
+            os << "\t\t<aggregate function=\"" << s.id() << "\" calls=\"" << a.calls << "\" duration=\"" << a.duration
+               << "\" self=\"" << a.self << "\" longest=\"" << a.longest << "\" violations=\"" << a.violations;
+            if (a.skipped)
+                os << "\" skipped=\"" << a.skipped;
+            os << "\" />\n";
+        }
+        if (aggregates)
+            os << "\t</aggregates>\n";
+
+        if (!profile.violations().empty())
+        {
+            os << "\t<violations>\n";
+            for (auto&& v : profile.violations())
+            {
+                os << "\t\t<violation call=\"" << v.call() << "\" function=\"" << v.function() << "\" duration=\"" << v.duration() << "\" budget=\"" << v.budget() << "\">\n";
+                for (auto&& f : v.stack())
+                    os << "\t\t\t<frame call=\"" << f.call << "\" function=\"" << f.function << "\" />\n";
+                for (auto&& f : v.children())
+                    os << "\t\t\t<child call=\"" << f.call << "\" function=\"" << f.function << "\" />\n";
+                os << "\t\t</violation>\n";
+            }
+            os << "\t</violations>\n";
+        }
+
+        if (!profile.downgrades().empty())
+        {
+            os << "\t<downgrades>\n";
+            for (auto&& d : profile.downgrades())
+            {
+                os << "\t\t<downgrade function=\"" << d.function() << "\" recording=\"" << d.recording() << "\" rate=\"" << d.rate()
+                   << "\" at=\"" << d.at() << "\" hits=\"" << d.hits() << "\" window=\"" << d.window() << "\" />\n";
+            }
+            os << "\t</downgrades>\n";
+        }
+    }
+
+    // Walks the profile in place, like the binary writer. Stopped by the
+    // job, the calls end with the ones written so far, followed only by
+    // the process, with the document closed.
+    void write(const collecting::profile_type<const char*>& profile, const char* filename, write_job* job)
+    {
+        output os(std::string(filename) + ".xcount");
+        std::unordered_map<const char*, std::string> names; // folded, by the raw name
         os << "<stats second=\"" << time::second() << "\">\n\t<functions>\n";
         for (auto& f : profile)
         {
             for (auto& s : f)
             {
-                os << "\t\t<fn id=\"" << s.id() << "\" name=\"" << xml(fold(f.nice()));
+                auto it = names.find(f.nice());
+                if (it == names.end())
+                    it = names.emplace(f.nice(), fold(f.nice())).first;
+
+                os << "\t\t<fn id=\"" << s.id() << "\" name=\"" << escaped(it->second);
                 if (s.name() && *s.name())
                     os << "\"\n\t\t    suffix=\"" << s.name();
                 os << "\"/>\n";
@@ -38,19 +238,75 @@ namespace profile { namespace io { namespace xml {
 
         os << "\t</functions>\n\t<calls>\n";
 
-        for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+        unsigned long long total = 0;
+        if (job)
         {
-            os << "\t\t<call id=\"" << c.id() << "\"";
-            if (c.parent())
-                os << " parent=\"" << c.parent() << "\"";
-            if (c.function())
-                os << " function=\"" << c.function() << "\"";
-            os << " duration=\"" << c.duration() << "\"";
-            if (c.isSysCall())
-                os << " syscall=\"true\"";
-            os << " />\n";
+            for (auto& f : profile) for (auto& s : f)
+                total += s.size();
         }
-        os << "\t</calls>\n</stats>\n";
+
+        call_id first = 0, last = 0;
+        unsigned long long written = 0;
+
+        // false, when the job stopped it
+        auto calls = [&]() -> bool {
+            for (auto& f : profile) for (auto& s : f) for (auto& c : s)
+            {
+                if (job && !(written % write_job::CALLS))
+                {
+                    if (written)
+                        job->written(written, total, os.size());
+                    if (job->expired())
+                        return false;
+                }
+                ++written;
+
+                if (!first || first > c.id())
+                    first = c.id();
+                if (last < c.id())
+                    last = c.id();
+
+                os << "\t\t<call id=\"" << c.id() << "\"";
+                if (c.parent())
+                    os << " parent=\"" << c.parent() << "\"";
+                if (c.function())
+                    os << " function=\"" << c.function() << "\"";
+                os << " duration=\"" << c.duration() << "\"";
+                if (c.hasSelf())
+                    os << " self=\"" << c.self() << "\"";
+                if (c.flags())
+                    os << " flags=\"" << c.flags() << "\"";
+                if (c.isSysCall())
+                    os << " syscall=\"true\"";
+                os << " />\n";
+            }
+            return true;
+        };
+
+        bool whole = calls();
+        os << "\t</calls>\n";
+
+        if (whole)
+            write_sections(os, profile);
+
+        os << "\t<processes>\n\t\t<process pid=\"" << process::id() << "\" parent=\"" << process::parent()
+           << "\" first=\"" << first << "\" last=\"" << last << "\" />\n\t</processes>\n";
+
+        os << "</stats>\n";
+
+        os.flush();
+        if (job)
+            job->written(written, total, os.size());
+    }
+
+    void write(const collecting::profile_type<const char*>& profile, const char* filename)
+    {
+        write(profile, filename, nullptr);
+    }
+
+    void write(const collecting::session& session, const char* filename, write_job* job)
+    {
+        session.lend([&](const collecting::profile_type<const char*>& profile) { write(profile, filename, job); });
     }
 
 }}} // profile::io::xml
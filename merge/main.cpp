@@ -0,0 +1,20 @@
+#include <profile/merge.hpp>
+#include <cstdio>
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <output.count> <input.count>...\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<std::string> inputs(argv + 2, argv + argc);
+	if (!profile::io::binary_merge(argv[1], inputs))
+	{
+		fprintf(stderr, "%s: could not merge into %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
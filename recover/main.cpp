@@ -0,0 +1,19 @@
+#include <profile/crash.hpp>
+#include <cstdio>
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <crash dump> <output.count>\n", argv[0]);
+		return 2;
+	}
+
+	if (!profile::io::crash_recover(argv[1], argv[2]))
+	{
+		fprintf(stderr, "%s: %s is not a crash dump\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Rebuilds a .count file from the dump of
+# a crashed program
+#
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = profile-recover
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += FEATURE_IO_READ
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../library/include
+
+CONFIG(debug, debug|release) {
+unix:LIBS += -L../library/debug -lprofile -lexpat -lz
+windows:LIBS += ../library/debug/profile.lib ../3rdparty/libexpat/debug/expat.lib
+}
+else {
+unix:LIBS += -L../library/release -lprofile -lexpat -lz
+windows:LIBS += ../library/release/profile.lib ../3rdparty/libexpat/release/expat.lib
+}
@@ -4,6 +4,10 @@ CONFIG += ordered
 SUBDIRS += \
     3rdparty \
     library \
-    viewer
+    viewer \
+    merge \
+    recover
 
 viewer.depends = 3rdparty library
+merge.depends = 3rdparty library
+recover.depends = 3rdparty library
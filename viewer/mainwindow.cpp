@@ -7,6 +7,7 @@
 #include <QMovie>
 #include <QSettings>
 #include <QLabel>
+#include <QLineEdit>
 #include "profiler_model.h"
 #include "call_tree_model.h"
 #include <profile/profile.hpp>
@@ -21,6 +22,7 @@ namespace Ui
 		QLabel* statusThrobber;
 		QMenu* columnMenu;
 		QActionGroup* viewGroup;
+		QLineEdit* filter;
 
 		void setupUi(QMainWindow *MainWindow)
 		{
@@ -44,6 +46,13 @@ namespace Ui
 			mainToolBar->addAction(actionColumns);
 			mainToolBar->toggleViewAction()->setDisabled(true);
 
+			filter = new QLineEdit(mainToolBar);
+			filter->setObjectName(QStringLiteral("filter"));
+			filter->setPlaceholderText(QStringLiteral("Filter calls, e.g. bytes > 1MB"));
+			filter->setClearButtonEnabled(true);
+			filter->setMaximumWidth(250);
+			mainToolBar->addWidget(filter);
+
 			viewGroup = new QActionGroup(MainWindow);
 			viewGroup->addAction(actionViewList);
 			viewGroup->addAction(actionViewCalls);
@@ -88,6 +97,7 @@ MainWindow::MainWindow(QWidget *parent) :
 	QObject::connect(m_nav, SIGNAL(selectStopped()),  this, SLOT(aTaskStopped_nav()));
 	QObject::connect(ui->columnMenu, SIGNAL(triggered(QAction*)), this, SLOT(onColumnChanged(QAction*)));
 	QObject::connect(ui->viewGroup, SIGNAL(triggered(QAction*)), this, SLOT(onViewChanged(QAction*)));
+	QObject::connect(ui->filter, SIGNAL(returnPressed()), this, SLOT(onFilterChanged()));
 
 	loadSettings();
 
@@ -170,7 +180,7 @@ QString FileDialog(MainWindow* pThis)
 {
 	SYSCALL_PROBE();
 
-	QFileDialog dlg(pThis, QString(), QString(), "Viewer files (*.xcount *.count);;XML files (*.xml);;All files (*.*)");
+	QFileDialog dlg(pThis, QString(), QString(), "Viewer files (*.xcount *.count *.index);;XML files (*.xml);;All files (*.*)");
 
 	dlg.setFileMode(QFileDialog::ExistingFile);
 	if (dlg.exec() == QDialog::Rejected)
@@ -357,3 +367,17 @@ void MainWindow::onViewChanged(QAction* action)
 	ui->stackedWidget->setCurrentIndex(page);
     ui->actionColumns->setVisible(page == ui->actionViewList->data().toInt());
 }
+
+void MainWindow::onFilterChanged()
+{
+	FUNCTION_PROBE();
+	profiler::filter filter;
+	if (!filter.parse(ui->filter->text()))
+	{
+		ui->statusMessage->setText(tr("Cannot parse filter %1.").arg(ui->filter->text()));
+		return;
+	}
+
+	m_nav->setFilter(filter);
+	home();
+}
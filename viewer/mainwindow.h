@@ -58,6 +58,7 @@ private slots:
 	void onColumnChanged(QAction* action);
 	void onColumnsMenu(QPoint pos);
 	void onViewChanged(QAction* action);
+	void onFilterChanged();
 
 signals:
 	void onBack();
@@ -46,7 +46,17 @@ void Navigator::doSelect(const HistoryItemPtr& item)
 
 	profiler::calls calls;
 	if (src.empty())
-		calls = m_data->select<profiler::calls>();
+	{
+		// navigating further follows the calls picked here
+		if (m_filter.empty())
+			calls = m_data->select<profiler::calls>();
+		else
+		{
+			auto data = m_data;
+			auto filter = m_filter;
+			calls = m_data->select<profiler::calls>().where([data, filter](const profiler::call& c){ return filter.matches(data->attributesOf(c.id())); });
+		}
+	}
 	else
 	{
 		for (profiler::call_id call: src)
@@ -62,6 +72,13 @@ void Navigator::doSelect(const HistoryItemPtr& item)
 	for (auto&& c: calls)
 		m_currentView->update(functions, c);
 
+	// calls counted under a latency budget have no place in the call
+	// tree, but still belong to the unfiltered totals
+	if (src.empty() && m_filter.empty())
+		m_currentView->updateAggregates(functions);
+	else
+		m_currentView->scaleThrottled();
+
 	m_currentView->normalize();
 
 	auto cached = m_currentView->get_cached();
@@ -120,11 +137,66 @@ Function::Function(const profiler::function_ptr& function, const profiler::call_
 	, m_ownTime(calledAs->ownTime())
 	, m_longest(calledAs->duration())
 	, m_shortest(calledAs->duration())
+	, m_lock_wait(calledAs->is_lock_wait() ? calledAs->duration() : 0)
+	, m_contentions(calledAs->is_lock_wait() ? 1 : 0)
+	, m_queue_wait(calledAs->is_queue_wait() ? calledAs->duration() : 0)
 	, m_at_least_one_syscall(calledAs->is_syscall())
+	, m_is_lock(calledAs->is_lock())
 {
 	m_calls.push_back(calledAs->id());
 }
 
+Function::Function(const profiler::function_ptr& function)
+	: m_function(function)
+	, m_call_count(0)
+	, m_sub_call_count(0)
+	, m_duration(0)
+	, m_ownTime(0)
+	, m_longest(0)
+	, m_shortest(0)
+	, m_lock_wait(0)
+	, m_contentions(0)
+	, m_queue_wait(0)
+	, m_at_least_one_syscall(false)
+	, m_is_lock(false)
+{
+}
+
+void Function::updateAggregate(const profiler::aggregate& counted)
+{
+	if (counted.calls)
+	{
+		if (!m_call_count || m_shortest > counted.duration / counted.calls)
+			m_shortest = counted.duration / counted.calls; // the best guess without the calls
+		m_call_count += counted.calls;
+		m_duration += counted.duration;
+		m_ownTime += counted.self;
+		if (m_longest < counted.longest)
+			m_longest = counted.longest;
+	}
+
+	// calls skipped by the governor were not timed, they are taken
+	// to be as long as the average timed one
+	if (counted.skipped)
+	{
+		if (m_call_count)
+			scale((double) (m_call_count + counted.skipped) / m_call_count);
+		else
+			m_call_count = counted.skipped;
+	}
+}
+
+void Function::scale(double factor)
+{
+	m_call_count = (unsigned long long) (m_call_count * factor + 0.5);
+	m_sub_call_count = (unsigned long long) (m_sub_call_count * factor + 0.5);
+	m_duration = (profiler::time_type) (m_duration * factor);
+	m_ownTime = (profiler::time_type) (m_ownTime * factor);
+	m_lock_wait = (profiler::time_type) (m_lock_wait * factor);
+	m_contentions = (unsigned long long) (m_contentions * factor + 0.5);
+	m_queue_wait = (profiler::time_type) (m_queue_wait * factor);
+}
+
 void Function::update(const profiler::call_ptr& calledAs)
 {
 	++m_call_count;
@@ -141,6 +213,18 @@ void Function::update(const profiler::call_ptr& calledAs)
 	{
 		m_at_least_one_syscall = true;
 	}
+
+	if (calledAs->is_lock_wait())
+	{
+		m_lock_wait += calledAs->duration();
+		++m_contentions;
+	}
+
+	if (calledAs->is_lock())
+		m_is_lock = true;
+
+	if (calledAs->is_queue_wait())
+		m_queue_wait += calledAs->duration();
 }
 
 void Functions::update(const profiler::functions& functions, const profiler::call_ptr& calledAs)
@@ -168,6 +252,45 @@ void Functions::update(const profiler::functions& functions, const profiler::cal
 	}
 }
 
+void Functions::updateAggregates(const profiler::functions& functions)
+{
+	for (auto&& f: functions)
+	{
+		auto& counted = f->aggregate();
+		if (!counted.calls && !counted.skipped)
+			continue;
+
+		FunctionPtr target;
+		for (auto&& known: m_functions)
+		{
+			if (known->id() == f->id())
+			{
+				target = known;
+				break;
+			}
+		}
+
+		if (!target)
+		{
+			target = std::make_shared<Function>(f);
+			m_functions.push_back(target);
+		}
+
+		target->updateAggregate(counted);
+	}
+}
+
+// the calls below a call are not counted by the collector, so a throttled
+// function is scaled by how many calls each of its kept calls stands for
+void Functions::scaleThrottled()
+{
+	for (auto&& f: m_functions)
+	{
+		if (f->is_throttled())
+			f->scale(f->scale_factor());
+	}
+}
+
 void Functions::normalize()
 {
 	m_max_duration = 1;
@@ -20,11 +20,18 @@ class Function
 	profiler::time_type    m_ownTime;
 	profiler::time_type    m_longest;
 	profiler::time_type    m_shortest;
+	profiler::time_type    m_lock_wait;
+	unsigned long long     m_contentions;
+	profiler::time_type    m_queue_wait;
 	bool                   m_at_least_one_syscall;
+	bool                   m_is_lock;
 
 public:
 	Function(const profiler::function_ptr& function, const profiler::call_ptr& calledAs);
+	explicit Function(const profiler::function_ptr& function);
 	void update(const profiler::call_ptr& calledAs);
+	void updateAggregate(const profiler::aggregate& counted);
+	void scale(double factor);
 	void updateSubcalls(const CalledAs& subcalls) { m_subcalls.insert(end(m_subcalls), begin(subcalls), end(subcalls)); }
 	profiler::function_id id() const { return m_function->id(); }
 
@@ -37,8 +44,18 @@ public:
 	profiler::time_type ownTime() const { return m_ownTime; }
 	profiler::time_type longest() const { return m_longest; }
 	profiler::time_type shortest() const { return m_shortest; }
+	profiler::time_type lock_wait() const { return m_lock_wait; }
+	unsigned long long contentions() const { return m_contentions; }
+	profiler::time_type queue_wait() const { return m_queue_wait; }
 	bool is_section() const { return m_function->is_section(); }
+	const profiler::io_stats& io() const { return m_function->io(); }
 	bool has_at_least_one_syscall() const {return m_at_least_one_syscall; }
+	bool is_lock() const { return m_is_lock; }
+	unsigned long long violations() const { return m_function->aggregate().violations; }
+	bool is_throttled() const { return m_function->is_throttled(); }
+	double scale_factor() const { return m_function->scale(); }
+	profile::ERecording recording() const { return m_function->recording(); }
+	unsigned int rate() const { return m_function->rate(); }
 };
 
 typedef std::shared_ptr<Function> FunctionPtr;
@@ -51,6 +68,8 @@ class Functions
 	profiler::time_type m_max_duration_avg;
 public:
 	void update(const profiler::functions& functions, const profiler::call_ptr& calledAs);
+	void updateAggregates(const profiler::functions& functions);
+	void scaleThrottled();
 	size_t size() const { return m_functions.size(); }
 	FunctionPtr at(size_t ndx) const { return m_functions.at(ndx); }
 	functions::const_iterator begin() const { return m_functions.begin(); }
@@ -80,6 +99,15 @@ public:
 		m_cached->update(functions, calledAs);
 	}
 
+	void updateAggregates(const profiler::functions& functions)
+	{
+		if (!m_cached)
+			m_cached = std::make_shared<Functions>();
+		m_cached->updateAggregates(functions);
+	}
+
+	void scaleThrottled() { if (m_cached) m_cached->scaleThrottled(); }
+
 	void normalize() { if (m_cached) m_cached->normalize(); }
 	profiler::time_type max_duration() const { return m_cached ? m_cached->max_duration() : 1; }
 private:
@@ -123,6 +151,7 @@ class Navigator : public QObject
 	Q_OBJECT
 
 	profiler::data_ptr m_data;
+	profiler::filter m_filter;
 	History m_history;
 	HistoryItemPtr m_currentView;
 
@@ -131,6 +160,7 @@ class Navigator : public QObject
 public:
 	explicit Navigator(QObject *parent = 0);
 	void setData(const profiler::data_ptr& data) { m_data = data; }
+	void setFilter(const profiler::filter& filter) { m_filter = filter; }
 	HistoryItemPtr current() { return m_currentView; }
 
 signals:
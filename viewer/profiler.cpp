@@ -2,26 +2,21 @@
 #include <QFile>
 #include <QDomDocument>
 #include <QDebug>
+#include <QRegularExpression>
 #include <cctype>
+#include <unordered_map>
 #include <profile/profile.hpp>
 #include <profile/read.hpp>
+#include <profile/rotate.hpp>
 
 namespace profiler
 {
-	call_ptr find_by_id(const profiler::calls& calls, call_id id)
-	{
-		for (auto&& c: calls)
-			if (c->id() == id)
-				return c;
-
-		return nullptr;
-	}
-
 	void data::rebuild_profile(const profile::io::file_contents& file)
 	{
 		m_second = file.m_second;
 		m_calls.clear();
 		m_functions.clear();
+		m_attributes.clear();
 
 		for (auto&& f: file.m_profile)
 		{
@@ -33,33 +28,200 @@ namespace profiler
 
 				m_functions.push_back(std::make_shared<function>(s.id(), name, !s.name().empty()));
 
+				unsigned long long kept = 0;
 				for (auto&& c: s)
 				{
-					m_calls.push_back(std::make_shared<call>(c.id(), c.parent(), c.function(), c.duration(), c.flags()));
+					m_calls.push_back(std::make_shared<call>(c.id(), c.parent(), c.function(), c.duration(), c.self(), c.flags()));
+					++kept;
+				}
+				m_functions.back()->set_kept(kept);
+
+				auto& a = s.aggregate();
+				if (!a.empty())
+				{
+					profiler::aggregate agg;
+					agg.calls = a.calls;
+					agg.duration = a.duration;
+					agg.self = a.self;
+					agg.longest = a.longest;
+					agg.violations = a.violations;
+					agg.skipped = a.skipped;
+					m_functions.back()->set_aggregate(agg);
 				}
 			}
 		}
 
+		// the own time of the calls from files without the self times,
+		// and the subcall counts of all of them
+		std::unordered_map<call_id, call*> by_id;
+		by_id.reserve(m_calls.size());
+		for (auto&& c: m_calls)
+			by_id[c->id()] = c.get();
+
 		for (auto&& c: m_calls)
 		{
 			auto parent_id = c->parent();
-			if (!parent_id)
+			if (!parent_id || c->is_async())
 				continue;
 
-			auto parent = find_by_id(m_calls, c->parent());
-			if (parent)
-				parent->detract(c->duration());
+			auto parent = by_id.find(parent_id);
+			if (parent != by_id.end())
+				parent->second->detract(c->duration());
+		}
+
+		for (auto&& io: file.m_profile.io())
+		{
+			for (auto&& f: m_functions)
+			{
+				if (f->id() == io.function())
+				{
+					f->add_io(io.calls(), io.bytes(), io.duration(), io.histogram(), profile::collecting::io_stats::BUCKETS);
+					break;
+				}
+			}
+		}
+
+		// the last downgrade of a function is the one in force
+		for (auto&& d: file.m_profile.downgrades())
+		{
+			for (auto&& f: m_functions)
+			{
+				if (f->id() == d.function())
+				{
+					f->set_recording(d.recording(), d.rate());
+					break;
+				}
+			}
+		}
+
+		for (auto&& a: file.m_profile.attributes())
+		{
+			auto name = QString::fromStdString(a.name());
+			if (a.isTag())
+				m_attributes[a.call()].emplace_back(name, QString::fromStdString(a.tag()));
+			else
+				m_attributes[a.call()].emplace_back(name, a.value());
 		}
 
 		qDebug() << "Got" << m_calls.size() << "calls and" << m_functions.size() << "functions.\n";
 	}
 
+	bool filter::parse(const QString& expression)
+	{
+		static QRegularExpression re("^\\s*([A-Za-z_][\\w.]*)\\s*(==|!=|<=|>=|<|>|=)\\s*(.*?)\\s*$");
+		static QRegularExpression number("^(\\d+)\\s*([kKmMgG]?)[bB]?$");
+
+		std::vector<condition> conditions;
+		for (auto&& part: expression.split("&&", QString::SkipEmptyParts))
+		{
+			auto match = re.match(part);
+			if (!match.hasMatch())
+				return false;
+
+			condition cond;
+			cond.name = match.captured(1);
+
+			auto op = match.captured(2);
+			if (op == "==" || op == "=") cond.op = EOp_EQ;
+			else if (op == "!=") cond.op = EOp_NE;
+			else if (op == "<") cond.op = EOp_LT;
+			else if (op == "<=") cond.op = EOp_LE;
+			else if (op == ">") cond.op = EOp_GT;
+			else cond.op = EOp_GE;
+
+			cond.text = match.captured(3);
+			cond.value = 0;
+			auto num = number.match(cond.text);
+			cond.numeric = num.hasMatch();
+			if (cond.numeric)
+			{
+				cond.value = num.captured(1).toULongLong();
+				auto unit = num.captured(2).toUpper();
+				if (unit == "K") cond.value <<= 10;
+				else if (unit == "M") cond.value <<= 20;
+				else if (unit == "G") cond.value <<= 30;
+			}
+			else if (cond.op != EOp_EQ && cond.op != EOp_NE)
+				return false;
+
+			conditions.push_back(cond);
+		}
+
+		m_conditions.swap(conditions);
+		return true;
+	}
+
+	template <typename T>
+	static bool compare(const T& lhs, const T& rhs, int op)
+	{
+		switch (op)
+		{
+		case 0: return lhs == rhs;
+		case 1: return lhs != rhs;
+		case 2: return lhs < rhs;
+		case 3: return lhs <= rhs;
+		case 4: return lhs > rhs;
+		case 5: return lhs >= rhs;
+		}
+		return false;
+	}
+
+	bool filter::condition::matches(const attribute& attr) const
+	{
+		if (attr.name() != name)
+			return false;
+
+		if (attr.is_tag())
+			return compare(attr.tag(), text, op);
+
+		if (!numeric)
+			return compare(QString::number(attr.value()), text, op);
+
+		return compare(attr.value(), value, op);
+	}
+
+	bool filter::matches(const attributes* attrs) const
+	{
+		for (auto&& cond: m_conditions)
+		{
+			if (!attrs)
+				return false;
+
+			bool found = false;
+			for (auto&& attr: *attrs)
+			{
+				if (cond.matches(attr))
+				{
+					found = true;
+					break;
+				}
+			}
+
+			if (!found)
+				return false;
+		}
+
+		return true;
+	}
+
 	bool data::open(const QString &path)
 	{
+		if (path.endsWith(".index"))
+			return open(path, 0, ~0ull);
+
 		profile::io::file_contents out;
 		if (profile::io::read(path.toStdString().c_str(), out))
 			return rebuild_profile(out), true;
 
 		return false;
 	}
+
+	bool data::open(const QString& index, time_type from, time_type to)
+	{
+		profile::io::file_contents out;
+		if (profile::io::read_segments(index.toStdString().c_str(), from, to, out))
+			return rebuild_profile(out), true;
+
+		return false;
+	}
 }
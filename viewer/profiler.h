@@ -1,6 +1,7 @@
 #ifndef PROFILER_H
 #define PROFILER_H
 
+#include <map>
 #include <memory>
 #include <vector>
 #include <QString>
@@ -11,7 +12,7 @@ namespace profile { namespace io { struct file_contents; }}
 
 namespace profiler
 {
-	typedef unsigned long long call_id;
+	typedef profile::call_id call_id;
 	typedef unsigned long long function_id;
 	typedef unsigned long long time_type;
 
@@ -25,18 +26,81 @@ namespace profiler
 		static type select(const klass& i) { return i.accessor(); } \
 	}
 
+	struct io_stats
+	{
+		unsigned long long calls;
+		unsigned long long bytes;
+		time_type duration;
+		std::vector<unsigned long long> histogram; // log2 of the transfer size
+
+		io_stats(): calls(0), bytes(0), duration(0) {}
+	};
+
+	// calls counted under a latency budget instead of being kept
+	struct aggregate
+	{
+		unsigned long long calls;
+		time_type duration;
+		time_type self;
+		time_type longest;
+		unsigned long long violations;
+		unsigned long long skipped; // neither kept nor timed
+
+		aggregate(): calls(0), duration(0), self(0), longest(0), violations(0), skipped(0) {}
+	};
+
 	class function
 	{
 		QString m_name;
 		function_id m_id;
 		bool m_is_section;
+		io_stats m_io;
+		profiler::aggregate m_aggregate;
+		profile::ERecording m_recording;
+		unsigned int m_rate;
+		unsigned long long m_kept;
 	public:
 		function() {}
-		function(function_id id, const QString& name, bool is_section): m_name(name), m_id(id), m_is_section(is_section) {}
+		function(function_id id, const QString& name, bool is_section)
+			: m_name(name)
+			, m_id(id)
+			, m_is_section(is_section)
+			, m_recording(profile::ERecording_FULL)
+			, m_rate(1)
+			, m_kept(0)
+		{}
 
 		const QString& name() const { return m_name; }
 		function_id id() const { return m_id; }
 		bool is_section() const { return m_is_section; }
+		const io_stats& io() const { return m_io; }
+		void add_io(unsigned long long calls, unsigned long long bytes, time_type duration, const unsigned long long* histogram, size_t buckets)
+		{
+			m_io.calls += calls;
+			m_io.bytes += bytes;
+			m_io.duration += duration;
+			if (m_io.histogram.size() < buckets)
+				m_io.histogram.resize(buckets);
+			for (size_t i = 0; i < buckets; ++i)
+				m_io.histogram[i] += histogram[i];
+		}
+		const profiler::aggregate& aggregate() const { return m_aggregate; }
+		void set_aggregate(const profiler::aggregate& a) { m_aggregate = a; }
+
+		// downgraded by the overhead governor
+		profile::ERecording recording() const { return m_recording; }
+		unsigned int rate() const { return m_rate; }
+		bool is_throttled() const { return m_recording != profile::ERecording_FULL; }
+		void set_recording(profile::ERecording recording, unsigned int rate) { m_recording = recording; m_rate = rate; }
+		void set_kept(unsigned long long kept) { m_kept = kept; }
+
+		// how many calls each kept call of a throttled function stands for
+		double scale() const
+		{
+			if (!is_throttled() || !m_kept)
+				return 1;
+			return (double) (m_kept + m_aggregate.calls + m_aggregate.skipped) / m_kept;
+		}
 
 		FIELD(function, name_field,     name);
 		FIELD(function, parent_field,   id);
@@ -52,16 +116,18 @@ namespace profiler
 		call_id      m_parent;
 		function_id  m_function;
 		time_type    m_duration;
+		time_type    m_self;     // as written by the probes, if known
 		time_type    m_detract;
 		size_t       m_subcalls;
 		unsigned int m_flags;
 	public:
 		call() {}
-		call(call_id id, call_id parent, function_id function, time_type duration, unsigned int flags)
+		call(call_id id, call_id parent, function_id function, time_type duration, time_type self, unsigned int flags)
 			: m_id(id)
 			, m_parent(parent)
 			, m_function(function)
 			, m_duration(duration)
+			, m_self(self)
 			, m_detract(0)
 			, m_subcalls(0)
 			, m_flags(flags)
@@ -73,10 +139,15 @@ namespace profiler
 		call_id parent() const { return m_parent; }
 		function_id functionId() const { return m_function; }
 		time_type duration() const { return m_duration; }
-		time_type ownTime() const { return m_duration - m_detract; }
+		time_type ownTime() const { return m_self != profile::collecting::call::NO_SELF ? m_self : m_duration - m_detract; }
 		size_t subcalls() const { return m_subcalls; }
 		unsigned int flags() const { return m_flags; }
 		bool is_syscall() const { return m_flags & profile::ECallFlag_SYSCALL; }
+		bool is_lock_wait() const { return m_flags & profile::ECallFlag_LOCK_WAIT; }
+		bool is_lock() const { return m_flags & (profile::ECallFlag_LOCK_WAIT | profile::ECallFlag_LOCK_HOLD | profile::ECallFlag_COND_WAIT); }
+		bool is_queue_wait() const { return m_flags & profile::ECallFlag_QUEUE_WAIT; }
+		// not within the time of its parent, which only submitted it
+		bool is_async() const { return m_flags & (profile::ECallFlag_QUEUE_WAIT | profile::ECallFlag_TASK); }
 
 		FIELD(call, id_field,         id);
 		FIELD(call, parent_field,     parent);
@@ -89,6 +160,57 @@ namespace profiler
 	typedef std::weak_ptr<call> weak_call_ptr;
 	typedef std::vector<call_ptr> calls;
 
+	class attribute
+	{
+		QString m_name;
+		QString m_tag;
+		unsigned long long m_value;
+		bool m_is_tag;
+	public:
+		attribute(): m_value(0), m_is_tag(false) {}
+		attribute(const QString& name, unsigned long long value): m_name(name), m_value(value), m_is_tag(false) {}
+		attribute(const QString& name, const QString& tag): m_name(name), m_tag(tag), m_value(0), m_is_tag(true) {}
+
+		const QString& name() const { return m_name; }
+		const QString& tag() const { return m_tag; }
+		unsigned long long value() const { return m_value; }
+		bool is_tag() const { return m_is_tag; }
+	};
+
+	typedef std::vector<attribute> attributes;
+
+	// Conjunction of attribute conditions, e.g. "bytes > 1MB && method == GET".
+	// Numbers may use K, M and G (binary) suffixes; tags compare as text.
+	class filter
+	{
+		enum EOp
+		{
+			EOp_EQ,
+			EOp_NE,
+			EOp_LT,
+			EOp_LE,
+			EOp_GT,
+			EOp_GE
+		};
+
+		struct condition
+		{
+			QString name;
+			EOp op;
+			bool numeric;
+			unsigned long long value;
+			QString text;
+
+			bool matches(const attribute& attr) const;
+		};
+
+		std::vector<condition> m_conditions;
+	public:
+		bool parse(const QString& expression);
+		bool empty() const { return m_conditions.empty(); }
+		bool matches(const attributes* attrs) const;
+	};
+
 	template <typename T>
 	struct vector_selector
 	{
@@ -175,6 +297,7 @@ namespace profiler
 	{
 		profiler::functions m_functions;
 		profiler::calls m_calls;
+		std::map<call_id, profiler::attributes> m_attributes;
 		time_type m_second;
 
 		template <typename T> struct select_data;
@@ -197,6 +320,7 @@ namespace profiler
 	public:
 		data(): m_second(1) {}
 		bool open(const QString& path);
+		bool open(const QString& index, time_type from, time_type to); // the segments of a rotator covering from..to
 
 		time_type second() const { return m_second; }
 
@@ -215,6 +339,14 @@ namespace profiler
 		const profiler::functions& functions() const { return m_functions; }
 		const profiler::calls& calls() const { return m_calls; }
 
+		const profiler::attributes* attributesOf(call_id id) const
+		{
+			auto it = m_attributes.find(id);
+			if (it == m_attributes.end())
+				return nullptr;
+			return &it->second;
+		}
+
 		profiler::calls selectFunctionCalls(function_id fn)
 		{
 			return select<profiler::calls>().where([=](const call& c){ return c.functionId() == fn; });
@@ -3,6 +3,7 @@
 #include <QDebug>
 #include <QPainter>
 #include <QMenu>
+#include <QStringList>
 #include <sstream>
 
 ProfilerModel::ProfilerModel(QObject *parent)
@@ -251,6 +252,14 @@ ColumnBag::ColumnBag()
 	add<Graph>();
 	add<GraphAvg>();
 	add<Type>();
+	add<LockWait>();
+	add<Contentions>();
+	add<IoBytes>();
+	add<Throughput>();
+	add<IoSizes>();
+	add<Overruns>();
+	add<Recording>();
+	add<QueueWait>();
 }
 
 void ColumnBag::buildColumnMenu(QObject* parent, QMenu* menu)
@@ -409,3 +418,56 @@ QString Columns::impl::usageFormat(profiler::time_type max, profiler::time_type
 			.arg(own * 100 / max)
 			.arg((own * 10000 / max) % 100, 2, 10, QLatin1Char('0'));
 }
+
+QString Columns::impl::throughputFormat(double bytesPerSecond)
+{
+	static const char* units[] = { "B/s", "kB/s", "MB/s", "GB/s" };
+	size_t unit = 0;
+	while (bytesPerSecond >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1)
+	{
+		bytesPerSecond /= 1024;
+		++unit;
+	}
+
+	return QString("%1 %2").arg(bytesPerSecond, 0, 'f', 2).arg(units[unit]);
+}
+
+static QString bucketName(size_t bucket)
+{
+	// bucket N holds sizes below 2^N, bucket 0 is for empty transfers
+	if (!bucket)
+		return "0";
+
+	static const char* units[] = { "", "K", "M", "G" };
+	size_t unit = (bucket - 1) / 10;
+	if (unit >= sizeof(units) / sizeof(units[0]))
+		unit = sizeof(units) / sizeof(units[0]) - 1;
+	return QString("<%1%2").arg(1ull << (bucket - unit * 10)).arg(units[unit]);
+}
+
+QString Columns::impl::histogramFormat(const std::vector<unsigned long long>& histogram)
+{
+	QStringList out;
+	for (size_t bucket = 0; bucket < histogram.size(); ++bucket)
+	{
+		if (histogram[bucket])
+			out.push_back(QString("%1: %2").arg(bucketName(bucket)).arg(histogram[bucket]));
+	}
+	return out.join(", ");
+}
+
+size_t Columns::impl::histogramMedian(const std::vector<unsigned long long>& histogram)
+{
+	unsigned long long total = 0;
+	for (auto&& count: histogram)
+		total += count;
+
+	unsigned long long seen = 0;
+	for (size_t bucket = 0; bucket < histogram.size(); ++bucket)
+	{
+		seen += histogram[bucket];
+		if (seen * 2 >= total && total)
+			return bucket;
+	}
+	return 0;
+}
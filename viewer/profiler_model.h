@@ -270,6 +270,9 @@ namespace Columns
 	{
 		QString timeFormat(profiler::time_type second, profiler::time_type ticks);
 		QString usageFormat(profiler::time_type max, profiler::time_type total, profiler::time_type own);
+		QString throughputFormat(double bytesPerSecond);
+		QString histogramFormat(const std::vector<unsigned long long>& histogram);
+		size_t histogramMedian(const std::vector<unsigned long long>& histogram);
 
 		struct Direct { enum { SCALE = 1 }; };
 		struct Scaled { enum { SCALE = 1000 }; };
@@ -416,6 +419,8 @@ namespace Columns
 		static QString title() { return "Type"; }
 		static QString getData(const Function& f)
 		{
+			if (f.is_lock())
+				return "Lock";
 			if (f.is_section())
 				return "Section";
 			if (f.has_at_least_one_syscall())
@@ -424,6 +429,8 @@ namespace Columns
 		}
 		static int intType(const Function& f)
 		{
+			if (f.is_lock())
+				return 3;
 			if (f.is_section())
 				return 1;
 			if (f.has_at_least_one_syscall())
@@ -498,6 +505,117 @@ namespace Columns
 		static profiler::time_type getData(const Function& f) { return f.ownTime() * SCALE / f.call_count(); }
 	};
 
+	struct LockWait: impl::TimeColumnInfo<LockWait>
+	{
+		static QString title() { return "Lock wait"; }
+		static profiler::time_type getData(const Function& f) { return f.lock_wait(); }
+	};
+
+	// time the tasks submitted from the parent spent waiting for a thread
+	struct QueueWait: impl::TimeColumnInfo<QueueWait>
+	{
+		static QString title() { return "Queue wait"; }
+		static profiler::time_type getData(const Function& f) { return f.queue_wait(); }
+	};
+
+	struct Contentions: impl::NumberColumnInfo<Contentions>
+	{
+		static QString title() { return "Contentions"; }
+		static QVariant getData(const Function& f)
+		{
+			auto count = f.contentions();
+			if (count)
+				return count;
+			return QVariant();
+		}
+		static bool less(const Function& lhs, const Function& rhs)
+		{
+			return lhs.contentions() < rhs.contentions();
+		}
+	};
+
+	struct IoBytes: impl::NumberColumnInfo<IoBytes>
+	{
+		static QString title() { return "I/O bytes"; }
+		static QVariant getData(const Function& f)
+		{
+			if (f.io().calls)
+				return f.io().bytes;
+			return QVariant();
+		}
+		static bool less(const Function& lhs, const Function& rhs)
+		{
+			return lhs.io().bytes < rhs.io().bytes;
+		}
+	};
+
+	struct Throughput: impl::NumberColumnInfo<Throughput>
+	{
+		static QString title() { return "Throughput"; }
+		static double getData(const Function& f)
+		{
+			auto& io = f.io();
+			if (!io.duration)
+				return 0;
+			return (double) io.bytes / io.duration; // bytes per tick
+		}
+		static QVariant getDisplayData(const ProfilerModel* parent, const Function& f)
+		{
+			if (!f.io().calls)
+				return QVariant();
+			return impl::throughputFormat(getData(f) * parent->second());
+		}
+	};
+
+	struct IoSizes: impl::ColumnInfo<IoSizes>
+	{
+		static QString title() { return "I/O sizes"; }
+		static QString getData(const Function& f) { return impl::histogramFormat(f.io().histogram); }
+		static bool less(const Function& lhs, const Function& rhs)
+		{
+			return impl::histogramMedian(lhs.io().histogram) < impl::histogramMedian(rhs.io().histogram);
+		}
+	};
+
+	struct Overruns: impl::NumberColumnInfo<Overruns>
+	{
+		static QString title() { return "Budget overruns"; }
+		static QVariant getData(const Function& f)
+		{
+			auto count = f.violations();
+			if (count)
+				return count;
+			return QVariant();
+		}
+		static bool less(const Function& lhs, const Function& rhs)
+		{
+			return lhs.violations() < rhs.violations();
+		}
+	};
+
+	struct Recording: impl::ColumnInfo<Recording>
+	{
+		static QString title() { return "Recording"; }
+		static QString getData(const Function& f)
+		{
+			switch (f.recording())
+			{
+			case profile::ERecording_COUNTED:
+				return "Counted";
+			case profile::ERecording_SAMPLED:
+				return QString("Sampled 1/%1").arg(f.rate());
+			default:
+				return QString();
+			}
+		}
+		static bool less(const Function& lhs, const Function& rhs)
+		{
+			if (lhs.recording() != rhs.recording())
+				return lhs.recording() < rhs.recording();
+			return lhs.rate() < rhs.rate();
+		}
+	};
+
 	struct Graph: impl::GraphColumnInfo<Graph, TotalTime, OwnTime>
 	{
 		static QString title() { return "Time"; }
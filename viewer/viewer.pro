@@ -42,11 +42,11 @@ SOURCES += win32_setIcon.cpp
 INCLUDEPATH += ../library/include
 
 CONFIG(debug, debug|release) {
-unix:LIBS += -L../library/debug -lprofile -lexpat
+unix:LIBS += -L../library/debug -lprofile -lexpat -lz
 windows:LIBS += ../library/debug/profile.lib ../3rdparty/libexpat/debug/expat.lib
 }
 else {
-unix:LIBS += -L../library/release -lprofile -lexpat
+unix:LIBS += -L../library/release -lprofile -lexpat -lz
 windows:LIBS += ../library/release/profile.lib ../3rdparty/libexpat/release/expat.lib
 }
 